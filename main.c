@@ -3,45 +3,131 @@
 //
 //  A simple utility for reading "xrec" binary load files (as
 //  used by SWTPC tapes and maybe others) and converting to
-//  Motorola S-record text format on stdout.
+//  Motorola S-record text format on stdout (or a file).
 //
 // Copyright (c) 2022 Ben Zotto
 //
 
+// Make off_t 64 bits even where long is 32, for seeking to indexed records.
+#define _FILE_OFFSET_BITS 64
+
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "xrec.h"
+#include "xrec_align.h"
+#include "xrec_bin.h"
+#include "xrec_cache.h"
+#include "xrec_checkpoint.h"
+#include "xrec_coverage.h"
+#include "xrec_dedupe.h"
+#include "xrec_fingerprint.h"
+#include "xrec_index.h"
+#include "xrec_kernels.h"
+#include "xrec_kcs.h"
+#include "xrec_merge.h"
+#include "xrec_reader.h"
+#include "xrec_repair.h"
+#include "xrec_ring.h"
+#include "xrec_split.h"
+#include "xrec_srec.h"
+
+#define WAV_CHUNK_SIZE              65536
+#define MAX_REPAIR_CANDIDATES       4
+#define READ_CHUNK_SIZE             (1024 * 1024)
+#define PARSE_CHUNK_SIZE            0x40000000
+#define OUTPUT_BUFFER_SIZE          (1024 * 1024)
+#define CHECKPOINT_INTERVAL         (16 * 1024 * 1024)
+#define CHECKPOINT_PATH_MAX         1024
+#define SPLIT_PATH_MAX              1024
+#define MAX_SPLIT_THREADS           64
+#define MAX_COVERAGE_RANGES_SHOWN   8
 
-#define MAX_DATA_BYTES_PER_LINE     16
+// Everything the parser callback needs on its way to the writer.
+struct convert_state {
+    struct srec_state * srec;
+    struct xrec_bin_writer * binary; // If not NULL, records are written here instead.
+    int repair;           // Nonzero to attempt repairs of checksum failures.
+    int repaired_records;
+    int failed_records;   // Data records delivered with checksum errors that weren't repaired.
+    int expected_address; // Where the next data record should start, or -1.
+    struct xrec_index * index; // If not NULL, every record is added here.
+    int index_error;
+    struct xrec_ring * ring;   // If not NULL, records are queued for the writer thread.
+    unsigned long checkpoint_at; // If not 0, pause after the record that reaches this position.
+    struct xrec_dedupe * dedupe; // If not NULL, duplicate records are skipped.
+    int held_termination; // Nonzero if a termination record is held back until the end.
+    struct xrec_coverage * coverage; // If not NULL, the addresses written are tracked here.
+    struct xrec_fingerprint * fingerprint; // If not NULL, the loaded image is hashed here.
+};
+
+// Where a cache miss sends its S-records: the output, and the new entry.
+struct cached_output {
+    FILE * output;
+    FILE * entry;
+};
 
-struct srec_state {
-    uint16_t address; // Starting address of this record
-    uint8_t data[MAX_DATA_BYTES_PER_LINE]; // This is the largest byte count we'll output.
-    int length;       // Valid bytes in the data buffer.
-    int last_record_type;
+// Work shared by the threads that format the programs of a split capture.
+struct split_job {
+    const uint8_t * data;
+    const struct xrec_program * programs;
+    long count;
+    const char * prefix;
+    int repair;
+    pthread_mutex_t lock;
+    long next;            // The next program to format, under the lock.
+    int failed;           // Nonzero if any program couldn't be written, under the lock.
 };
 
+void write_output(struct convert_state * convert, int record_type, uint16_t address,
+                  const uint8_t * data, int length, int checksum_error);
+void deliver_record(struct convert_state * convert, int record_type, uint16_t address,
+                    const uint8_t * data, int length, int checksum_error);
+
 void print_usage(const char * program)
 {
-    printf("usage: %s input_file\n", program);
+    printf("usage: %s [-a | -w] [-p] [-r | -f low-high] [-d] [-v] [-x] [-b] [-o output_file] input_file\n", program);
+    printf("       %s [-a] [-p] [-f low-high] [-v] [-x] -c cache_dir [-o output_file] input_file\n", program);
+    printf("       %s [-a] [-r] -k checkpoint_file -o output_file input_file\n", program);
+    printf("       %s [-a] [-r] -s output_prefix input_file\n", program);
+    printf("       %s -m [-p] [-r] [-d] [-v] [-x] [-b] input_file input_file...\n", program);
+    printf("       %s -q low-high -i index_file input_file\n", program);
+    printf("  -a    search all bit alignments for mis-framed captures\n");
+    printf("  -w    input is a Kansas City Standard (300 baud) WAV recording\n");
+    printf("  -i    write a record index of the input to index_file (or with -q, read it)\n");
+    printf("  -q    convert only the records overlapping hex addresses low-high, using the index\n");
+    printf("  -m    merge several captures of the same tape into one best-effort image\n");
+    printf("  -c    reuse (or store) the output for identical input in cache_dir; not with -r or -d,\n"
+           "        whose reports on stderr a cached copy couldn't repeat\n");
+    printf("  -p    pipeline: read ahead, parse, and format output on separate threads\n");
+    printf("  -b    write a binary record stream with an index instead of S-records\n");
+    printf("  -o    write the output to output_file instead of stdout\n");
+    printf("  -k    checkpoint progress to checkpoint_file, and resume from it if it exists\n");
+    printf("  -s    split a capture of several programs into output_prefix-1.s19 and so on\n");
+    printf("  -f    convert only the data at hex addresses low-high, trimming records that overlap it\n");
+    printf("  -v    report the addresses covered, written more than once, and left as gaps\n");
+    printf("  -x    report the CRC-32 and XXH64 hashes of the memory image the tape loads\n");
+    printf("  -d    skip duplicate records, e.g. from a second copy of the program\n");
+    printf("  -r    repair records with checksum errors where a single correction is\n"
+           "        clearly most plausible; candidates are reported on stderr\n");
 }
 
-int main(int argc, const char * argv[])
+// Read an entire file into a newly allocated buffer, hashing it along the
+// way if `hash` is not NULL. Returns NULL (after reporting why) on failure.
+unsigned char * read_file(const char * path, long * size, uint64_t * hash)
 {
-    if (argc != 2) {
-        print_usage(argv[0]);
-        return -1;
-    }
-    
-    FILE * file = fopen(argv[1], "rb");
+    FILE * file = fopen(path, "rb");
     if (!file) {
-        printf("Unable to open %s\n", argv[1]);
-        return -1;
+        printf("Unable to open %s\n", path);
+        return NULL;
     }
     
     if (fseek(file, 0 , SEEK_END) != 0) {
-        printf("Error reading %s\n", argv[1]);
-        return -1;
+        printf("Error reading %s\n", path);
+        fclose(file);
+        return NULL;
     }
 
     long file_size = ftell(file);
@@ -50,100 +136,1096 @@ int main(int argc, const char * argv[])
     if (data == NULL){
         printf("File too large to allocate work buffer");
         fclose(file);
-        return -1;
+        return NULL;
     }
     
     if (fseek(file, 0 , SEEK_SET) != 0) {
-        printf("Error reading %s\n", argv[1]);
+        printf("Error reading %s\n", path);
         free(data);
         fclose(file);
-        return -1;
+        return NULL;
     }
     
-    unsigned long bytes_read = fread(data, 1, file_size, file);
+    unsigned long bytes_read = 0;
+    unsigned long chunk_read;
+    do {
+        unsigned long chunk = file_size - bytes_read;
+        if (chunk > READ_CHUNK_SIZE) {
+            chunk = READ_CHUNK_SIZE;
+        }
+        chunk_read = fread(data + bytes_read, 1, chunk, file);
+        if (hash != NULL) {
+            *hash = xrec_hash_bytes(*hash, data + bytes_read, chunk_read);
+        }
+        bytes_read += chunk_read;
+    } while (chunk_read > 0 && bytes_read < (unsigned long)file_size);
     fclose(file);
-    if (bytes_read != file_size) {
-        printf("Error reading %s\n", argv[1]);
+    if (bytes_read != (unsigned long)file_size) {
+        printf("Error reading %s\n", path);
         free(data);
+        return NULL;
+    }
+    *size = file_size;
+    return data;
+}
+
+// Parse a file as it is read ahead on a background thread. Returns nonzero on
+// success.
+int read_streamed(const char * path, struct xrec_state * xrec)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file) {
+        printf("Unable to open %s\n", path);
+        return 0;
+    }
+    struct xrec_reader reader;
+    if (!xrec_reader_start(&reader, file)) {
+        printf("Unable to start reading %s\n", path);
+        fclose(file);
+        return 0;
+    }
+    const uint8_t * chunk;
+    size_t length;
+    while ((chunk = xrec_reader_next(&reader, &length)) != NULL) {
+        xrec_read_bytes(xrec, (const char *)chunk, (int)length);
+        xrec_reader_release(&reader);
+    }
+    int success = xrec_reader_finish(&reader);
+    fclose(file);
+    if (!success) {
+        printf("Error reading %s\n", path);
+    }
+    return success;
+}
+
+// Demodulate a WAV recording a chunk at a time straight into the parser,
+// with any warning going to `notes`. Returns nonzero on success.
+int read_wav(const char * path, struct xrec_state * xrec, FILE * notes)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file) {
+        printf("Unable to open %s\n", path);
+        return 0;
+    }
+    
+    uint8_t buffer[WAV_CHUNK_SIZE];
+    long length = (long)fread(buffer, 1, sizeof(buffer), file);
+    struct kcs_wav_format wav;
+    struct kcs_state * kcs = malloc(sizeof(struct kcs_state));
+    if (kcs == NULL || !kcs_parse_wav(buffer, length, &wav) ||
+        !kcs_begin(kcs, &wav, KCS_BAUD_300, xrec) ||
+        fseek(file, wav.data_offset, SEEK_SET) != 0) {
+        printf("Unsupported WAV file %s\n", path);
+        free(kcs);
+        fclose(file);
+        return 0;
+    }
+    
+    // Read whole frames only, up to the end of the data chunk.
+    long chunk = sizeof(buffer) - sizeof(buffer) % wav.block_align;
+    long remaining = wav.data_length;
+    while (remaining > 0) {
+        length = (long)fread(buffer, 1, remaining < chunk ? remaining : chunk, file);
+        if (length <= 0) {
+            break;
+        }
+        kcs_read_pcm(kcs, buffer, length);
+        remaining -= length;
+    }
+    if (kcs->framing_errors > 0) {
+        fprintf(notes, "\nWarning: %ld byte(s) in the recording had framing errors.\n", kcs->framing_errors);
+    }
+    free(kcs);
+    fclose(file);
+    return 1;
+}
+
+// Parse several captures of the same tape and merge them into the parser,
+// reporting how they were merged to `notes`. Returns nonzero on success.
+int read_captures(const char ** paths, int count, struct xrec_state * xrec, FILE * notes)
+{
+    const uint8_t ** inputs = calloc(count, sizeof(*inputs));
+    long * lengths = calloc(count, sizeof(*lengths));
+    int success = inputs != NULL && lengths != NULL;
+    for (int i = 0; success && i < count; i++) {
+        inputs[i] = read_file(paths[i], &lengths[i], NULL);
+        success = inputs[i] != NULL;
+    }
+    
+    struct xrec_merge_stats stats;
+    if (success && !xrec_merge_captures(inputs, lengths, count, xrec, &stats)) {
+        printf("Not enough memory to merge captures\n");
+        success = 0;
+    }
+    if (success) {
+        fprintf(notes, "\nNote: merged %d record(s) from %d captures: %d from valid copies, "
+               "%d rebuilt by vote (%d of which still fail their checksum).\n",
+               stats.records, count, stats.from_valid_copy,
+               stats.voted_valid + stats.voted_invalid, stats.voted_invalid);
+        if (stats.dropped > 0) {
+            fprintf(notes, "\nWarning: %d record(s) with no valid copy were dropped.\n", stats.dropped);
+        }
+    }
+    for (int i = 0; inputs != NULL && i < count; i++) {
+        free((void *)inputs[i]);
+    }
+    free(inputs);
+    free(lengths);
+    return success;
+}
+
+// Output sink for the S-record writer: the FILE in its context, which also
+// takes the final notes.
+void write_file(struct srec_state * srec, const char * text, size_t length)
+{
+    fwrite(text, 1, length, srec->context);
+}
+
+// Output sink for the S-record writer on a cache miss: the output, with a
+// copy going into the cache entry.
+void write_cached(struct srec_state * srec, const char * text, size_t length)
+{
+    struct cached_output * cached = srec->context;
+    fwrite(text, 1, length, cached->output);
+    fwrite(text, 1, length, cached->entry);
+}
+
+// Output sink for the binary record stream writer.
+void write_binary(struct xrec_bin_writer * writer, const uint8_t * data, size_t length)
+{
+    fwrite(data, 1, length, writer->context);
+}
+
+// Save a record index to a file. Returns nonzero on success.
+int write_index(const char * path, const struct xrec_index * index)
+{
+    size_t size = xrec_index_serialize(index, NULL);
+    uint8_t * buffer = malloc(size);
+    FILE * file = fopen(path, "wb");
+    int success = buffer != NULL && file != NULL;
+    if (success) {
+        xrec_index_serialize(index, buffer);
+        success = fwrite(buffer, 1, size, file) == size;
+    }
+    if (file != NULL && fclose(file) != 0) {
+        success = 0;
+    }
+    free(buffer);
+    return success;
+}
+
+// Decode just the records that the index says overlap `low` through `high`,
+// followed by the termination record if there is one, and list them in
+// `notes`. Returns nonzero on success.
+int read_indexed(const char * index_path, const char * input_path,
+                 uint16_t low, uint16_t high, struct xrec_state * xrec, FILE * notes)
+{
+    long index_size;
+    uint8_t * index_data = read_file(index_path, &index_size, NULL);
+    if (index_data == NULL) {
+        return 0;
+    }
+    struct xrec_index index;
+    int success = xrec_index_deserialize(&index, index_data, index_size);
+    free(index_data);
+    if (!success) {
+        printf("Invalid index file %s\n", index_path);
+        return 0;
+    }
+    FILE * file = fopen(input_path, "rb");
+    if (!file) {
+        printf("Unable to open %s\n", input_path);
+        xrec_index_free(&index);
+        return 0;
+    }
+    
+    char record[XREC_INDEX_RECORD_SIZE(XREC_INDEX_MAX_LENGTH)];
+    int found = 0;
+    long i = -1;
+    while (success && (i = xrec_index_find(&index, low, high, i)) >= 0) {
+        size_t size = XREC_INDEX_RECORD_SIZE(index.entries[i].length);
+        success = size <= sizeof(record) &&
+                  fseeko(file, (off_t)index.entries[i].offset, SEEK_SET) == 0 &&
+                  fread(record, 1, size, file) == size;
+        if (success) {
+            xrec_read_bytes(xrec, record, (int)size);
+            found++;
+        }
+    }
+    for (i = 0; success && i < index.count; i++) {
+        if (index.entries[i].type == XREC_TERMINATION_16BIT) {
+            success = fseeko(file, (off_t)index.entries[i].offset, SEEK_SET) == 0 &&
+                      fread(record, 1, 2, file) == 2;
+            if (success) {
+                xrec_read_bytes(xrec, record, 2);
+            }
+            break;
+        }
+    }
+    if (!success) {
+        printf("Error reading %s\n", input_path);
+    } else {
+        fprintf(notes, "\nNote: %d record(s) overlap $%04X-$%04X", found, low, high);
+        const char * separator = ", at input offset(s) ";
+        for (i = -1; (i = xrec_index_find(&index, low, high, i)) >= 0; separator = ", ") {
+            fprintf(notes, "%s%llu", separator, (unsigned long long)index.entries[i].offset);
+        }
+        fprintf(notes, ".\n");
+    }
+    fclose(file);
+    xrec_index_free(&index);
+    return success;
+}
+
+// Store a 32-bit count in a checkpoint, high byte first.
+uint8_t * put_count(uint8_t * p, int count)
+{
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        *p++ = ((uint32_t)count >> shift) & 0xFF;
+    }
+    return p;
+}
+
+// Load a count stored by `put_count`.
+uint32_t get_count(const uint8_t ** p)
+{
+    uint32_t count = 0;
+    for (int i = 0; i < 4; i++) {
+        count = (count << 8) | *(*p)++;
+    }
+    return count;
+}
+
+// Save a checkpoint of the conversion, with the parser between records at
+// `input_offset`. It is written to a temporary file and renamed into place,
+// so an interruption leaves the previous checkpoint intact. Returns nonzero
+// on success.
+int write_checkpoint(const char * path, const struct xrec_state * xrec,
+                     const struct convert_state * convert,
+                     uint64_t input_hash, uint64_t options_hash, long input_offset)
+{
+    const struct srec_state * srec = convert->srec;
+    if (fflush(srec->context) != 0) {
+        return 0;
+    }
+    struct xrec_checkpoint checkpoint;
+    xrec_checkpoint_capture(&checkpoint, xrec);
+    checkpoint.input_hash = input_hash;
+    checkpoint.options_hash = options_hash;
+    checkpoint.input_offset = input_offset;
+    checkpoint.output_offset = ftell(srec->context);
+    
+    // The pending output line and the conversion counters.
+    uint8_t * p = checkpoint.consumer;
+    *p++ = srec->address >> 8;
+    *p++ = srec->address & 0xFF;
+    *p++ = srec->length;
+    memcpy(p, srec->data, srec->length);
+    p += srec->length;
+    *p++ = srec->last_record_type;
+    p = put_count(p, convert->repaired_records);
+    p = put_count(p, convert->failed_records);
+    *p++ = convert->expected_address < 0;
+    *p++ = (convert->expected_address >> 8) & 0xFF;
+    *p++ = convert->expected_address & 0xFF;
+    checkpoint.consumer_length = (uint32_t)(p - checkpoint.consumer);
+    
+    char temp_path[CHECKPOINT_PATH_MAX];
+    if (snprintf(temp_path, sizeof(temp_path), "%s.tmp", path) >= (int)sizeof(temp_path)) {
+        return 0;
+    }
+    size_t size = xrec_checkpoint_serialize(&checkpoint, NULL);
+    uint8_t * buffer = malloc(size);
+    FILE * file = fopen(temp_path, "wb");
+    int success = buffer != NULL && file != NULL;
+    if (success) {
+        xrec_checkpoint_serialize(&checkpoint, buffer);
+        success = fwrite(buffer, 1, size, file) == size;
+    }
+    if (file != NULL && fclose(file) != 0) {
+        success = 0;
+    }
+    free(buffer);
+    return success && rename(temp_path, path) == 0;
+}
+
+// Load the checkpoint at `path`. Returns 1 if it was loaded, 0 if there is
+// none, or -1 (after reporting why) if it can't be used.
+int read_checkpoint(const char * path, struct xrec_checkpoint * checkpoint)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    fclose(file);
+    long size;
+    uint8_t * data = read_file(path, &size, NULL);
+    if (data == NULL) {
+        return -1;
+    }
+    int success = xrec_checkpoint_deserialize(checkpoint, data, size);
+    free(data);
+    if (!success) {
+        printf("Invalid checkpoint file %s\n", path);
+        return -1;
+    }
+    return 1;
+}
+
+// Put the conversion back into the state saved by `write_checkpoint`.
+// Returns nonzero on success.
+int restore_checkpoint(const struct xrec_checkpoint * checkpoint,
+                       struct xrec_state * xrec, struct convert_state * convert)
+{
+    struct srec_state * srec = convert->srec;
+    const uint8_t * p = checkpoint->consumer;
+    if (checkpoint->consumer_length < 3 ||
+        p[2] > SREC_MAX_DATA_BYTES_PER_LINE ||
+        checkpoint->consumer_length != 3u + p[2] + 12) {
+        return 0;
+    }
+    xrec_checkpoint_restore(checkpoint, xrec);
+    srec->address = (uint16_t)((p[0] << 8) | p[1]);
+    srec->length = p[2];
+    p += 3;
+    memcpy(srec->data, p, srec->length);
+    p += srec->length;
+    srec->last_record_type = *p++;
+    convert->repaired_records = (int)get_count(&p);
+    convert->failed_records = (int)get_count(&p);
+    convert->expected_address = p[0] ? -1 : (p[1] << 8) | p[2];
+    return 1;
+}
+
+// Write the notes and warnings that end each conversion.
+void write_notes(FILE * out, const struct xrec_state * xrec, const struct convert_state * convert)
+{
+    if (convert->repaired_records > 0) {
+        fprintf(out, "\nNote: %d record(s) with checksum errors were repaired.\n", convert->repaired_records);
+    }
+    if (convert->dedupe != NULL && convert->dedupe->duplicates > 0) {
+        fprintf(out, "\nNote: %ld duplicate record(s) were skipped.\n", convert->dedupe->duplicates);
+    }
+    if (convert->dedupe != NULL && convert->dedupe->fixed > 0) {
+        fprintf(out, "\nNote: %ld record(s) with checksum errors were replaced by a later valid copy.\n",
+                convert->dedupe->fixed);
+    }
+    if (xrec->last_strict_error == XREC_ERROR_UNKNOWN_RECORD_TYPE) {
+        fprintf(out, "\nWarning: input contained at least one unknown record type.\n");
+    } else if (convert->failed_records > 0) {
+        fprintf(out, "\nWarning: input contained at least one failed data checksum. Beware corruption!\n");
+    }
+    if (convert->srec->last_record_type != XREC_TERMINATION_16BIT) {
+        fprintf(out, "\nWarning: did not encounter (or emit) closing termination record.\n");
+    }
+}
+
+// List up to MAX_COVERAGE_RANGES_SHOWN ranges of one kind.
+void write_ranges(FILE * out, const struct xrec_coverage * coverage, enum xrec_coverage_kind kind)
+{
+    uint16_t low, high;
+    long shown = 0, more = 0;
+    for (long next = 0; (next = xrec_coverage_next_range(coverage, kind, next, &low, &high)) >= 0; ) {
+        if (shown == MAX_COVERAGE_RANGES_SHOWN) {
+            more++;
+            continue;
+        }
+        fprintf(out, "%s$%04X-$%04X", shown ? ", " : " ", low, high);
+        if (kind == XREC_COVERAGE_OVERLAP) {
+            int most = 0;
+            for (long a = low; a <= high; a++) {
+                int count = xrec_coverage_count(coverage, (uint16_t)a);
+                most = count > most ? count : most;
+            }
+            fprintf(out, " (%s%d times)", most > 255 ? "over " : "", most > 255 ? 255 : most);
+        }
+        shown++;
+    }
+    if (more > 0) {
+        fprintf(out, ", and %ld more", more);
+    }
+    fprintf(out, ".\n");
+}
+
+// Report the address coverage of the records converted.
+void write_coverage(FILE * out, const struct xrec_coverage * coverage)
+{
+    fprintf(out, "\nNote: %ld data record(s) cover %ld byte(s):", coverage->records,
+            xrec_coverage_total(coverage, XREC_COVERAGE_WRITTEN));
+    write_ranges(out, coverage, XREC_COVERAGE_WRITTEN);
+    long gaps = xrec_coverage_total(coverage, XREC_COVERAGE_GAP);
+    if (gaps > 0) {
+        fprintf(out, "\nNote: %ld byte(s) between them are not written:", gaps);
+        write_ranges(out, coverage, XREC_COVERAGE_GAP);
+    }
+    long overlaps = xrec_coverage_total(coverage, XREC_COVERAGE_OVERLAP);
+    if (overlaps > 0) {
+        fprintf(out, "\nWarning: %ld byte(s) are written more than once:", overlaps);
+        write_ranges(out, coverage, XREC_COVERAGE_OVERLAP);
+    }
+}
+
+// Split thread: convert programs of a split capture, each to its own file,
+// until there are none left.
+void * write_programs(void * context)
+{
+    struct split_job * job = context;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        long i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (i >= job->count) {
+            break;
+        }
+        
+        char path[SPLIT_PATH_MAX];
+        FILE * out = NULL;
+        if (snprintf(path, sizeof(path), "%s-%ld.s19", job->prefix, i + 1) < (int)sizeof(path)) {
+            out = fopen(path, "wb");
+        }
+        if (out == NULL) {
+            pthread_mutex_lock(&job->lock);
+            job->failed = 1;
+            pthread_mutex_unlock(&job->lock);
+            continue;
+        }
+        
+        struct srec_state srec;
+        srec_begin_write(&srec, write_file, out);
+        struct convert_state convert;
+        memset(&convert, 0, sizeof(convert));
+        convert.srec = &srec;
+        convert.repair = job->repair;
+        convert.expected_address = -1;
+        struct xrec_state xrec;
+        xrec_begin_read(&xrec);
+        xrec.context = &convert;
+        
+        const struct xrec_program * program = &job->programs[i];
+        xrec_read_bytes(&xrec, (const char *)job->data + program->start,
+                        (int)(program->end - program->start));
+        srec_flush(&srec);
+        write_notes(out, &xrec, &convert);
+        if (fclose(out) != 0) {
+            pthread_mutex_lock(&job->lock);
+            job->failed = 1;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+    return NULL;
+}
+
+// Find the programs in a capture, then convert them in parallel, each to its
+// own file. Returns nonzero on success.
+int write_split(const uint8_t * data, long length, const char * prefix, int repair)
+{
+    struct xrec_program * programs;
+    long count = xrec_split_programs(data, length, XREC_SPLIT_DEFAULT_GAP, &programs);
+    if (count < 0) {
+        printf("Not enough memory to split the input\n");
+        return 0;
+    }
+    struct split_job job;
+    job.programs = programs;
+    job.count = count;
+    job.data = data;
+    job.prefix = prefix;
+    job.repair = repair;
+    job.next = 0;
+    job.failed = 0;
+    pthread_mutex_init(&job.lock, NULL);
+    
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    long thread_count = online > 0 ? online : 1;
+    if (thread_count > job.count) {
+        thread_count = job.count;
+    }
+    if (thread_count > MAX_SPLIT_THREADS) {
+        thread_count = MAX_SPLIT_THREADS;
+    }
+    pthread_t threads[MAX_SPLIT_THREADS];
+    long started = 0;
+    while (started < thread_count &&
+           pthread_create(&threads[started], NULL, write_programs, &job) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        write_programs(&job);
+    }
+    for (long i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&job.lock);
+    
+    printf("Found %ld program(s).\n", job.count);
+    for (long i = 0; i < job.count; i++) {
+        const struct xrec_program * program = &job.programs[i];
+        printf("  %s-%ld.s19: %ld record(s) from input offset %ld to %ld%s\n",
+               prefix, i + 1, program->records, program->start, program->end,
+               program->terminated ? "" : ", without a termination record");
+    }
+    if (job.failed) {
+        printf("Unable to write every program with prefix %s\n", prefix);
+    }
+    free(programs);
+    return !job.failed;
+}
+
+// Writer thread for the pipelined mode: format the records queued by the
+// parser until the end-of-stream marker (a record of type zero) arrives.
+void * write_records(void * context)
+{
+    struct convert_state * convert = context;
+    for (;;) {
+        const struct xrec_record * record = xrec_ring_peek(convert->ring);
+        if (record->type == 0) {
+            xrec_ring_release(convert->ring);
+            break;
+        }
+        write_output(convert, record->type, record->address, record->data, record->length,
+                     record->checksum_error);
+        xrec_ring_release(convert->ring);
+    }
+    return NULL;
+}
+
+// Queue the end-of-stream marker and wait for the writer thread to drain.
+void finish_pipeline(struct convert_state * convert, pthread_t * writer)
+{
+    if (convert->ring == NULL) {
+        return;
+    }
+    xrec_ring_reserve(convert->ring)->type = 0;
+    xrec_ring_publish(convert->ring);
+    pthread_join(*writer, NULL);
+    free(convert->ring);
+    convert->ring = NULL;
+}
+
+int main(int argc, const char * argv[])
+{
+    // Use the fastest kernels for this CPU, unless told otherwise.
+    const char * kernel = getenv("XREC_KERNEL");
+    if (!xrec_kernels_init(kernel)) {
+        printf("Kernel set %s is unknown or not supported on this CPU\n", kernel);
         return -1;
     }
     
+    int align = 0;
+    int wav = 0;
+    int repair = 0;
+    int dedupe = 0;
+    int coverage = 0;
+    int fingerprint = 0;
+    int merge = 0;
+    int pipeline = 0;
+    int binary = 0;
+    const char * index_path = NULL;
+    const char * cache_path = NULL;
+    const char * output_path = NULL;
+    const char * checkpoint_path = NULL;
+    const char * split_prefix = NULL;
+    int query = 0;
+    unsigned long query_low = 0, query_high = 0;
+    int filter = 0;
+    unsigned long filter_low = 0, filter_high = 0xFFFF;
+    const char ** input_paths = calloc(argc, sizeof(*input_paths));
+    int input_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-a") == 0) {
+            align = 1;
+        } else if (strcmp(argv[i], "-w") == 0) {
+            wav = 1;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            repair = 1;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            dedupe = 1;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            coverage = 1;
+        } else if (strcmp(argv[i], "-x") == 0) {
+            fingerprint = 1;
+        } else if (strcmp(argv[i], "-m") == 0) {
+            merge = 1;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            pipeline = 1;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            binary = 1;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cache_path = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            split_prefix = argv[++i];
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            checkpoint_path = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            index_path = argv[++i];
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc &&
+                   sscanf(argv[++i], "%lx-%lx", &query_low, &query_high) == 2 &&
+                   query_low <= query_high && query_high <= 0xFFFF) {
+            query = 1;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc &&
+                   sscanf(argv[++i], "%lx-%lx", &filter_low, &filter_high) == 2 &&
+                   filter_low <= filter_high && filter_high <= 0xFFFF) {
+            filter = 1;
+        } else if (argv[i][0] == '-') {
+            print_usage(argv[0]);
+            return -1;
+        } else {
+            input_paths[input_count++] = argv[i];
+        }
+    }
+    if (input_count == 0 || align + wav + merge > 1 ||
+        (merge && input_count < 2) || (!merge && input_count > 1) ||
+        (query && index_path == NULL) ||
+        (index_path != NULL && align + wav + merge > 0) ||
+        (cache_path != NULL && (wav || merge || repair || dedupe || index_path != NULL)) ||
+        (checkpoint_path != NULL && (output_path == NULL || wav || merge || pipeline ||
+                                     index_path != NULL || cache_path != NULL)) ||
+        ((dedupe || coverage || fingerprint) && (checkpoint_path != NULL || split_prefix != NULL)) ||
+        (binary && (cache_path != NULL || checkpoint_path != NULL || split_prefix != NULL)) ||
+        (filter && (repair || index_path != NULL || split_prefix != NULL)) ||
+        (split_prefix != NULL && (wav || merge || pipeline || index_path != NULL ||
+                                  cache_path != NULL || output_path != NULL ||
+                                  checkpoint_path != NULL))) {
+        print_usage(argv[0]);
+        return -1;
+    }
+    const char * input_path = input_paths[0];
+    
+    // The options that change the output, which a cache entry or a
+    // checkpoint must have been made with to be used.
+    char options[32] = "";
+    if (align) {
+        strcat(options, "a");
+    }
+    if (wav) {
+        strcat(options, "w");
+    }
+    if (repair) {
+        strcat(options, "r");
+    }
+    if (dedupe) {
+        strcat(options, "d");
+    }
+    if (coverage) {
+        strcat(options, "v");
+    }
+    if (fingerprint) {
+        strcat(options, "x");
+    }
+    if (binary) {
+        strcat(options, "b");
+    }
+    if (filter) {
+        sprintf(options + strlen(options), "f%04lX-%04lX", filter_low, filter_high);
+    }
+    uint64_t options_hash = xrec_hash_bytes(XREC_HASH_SEED, (const uint8_t *)options, strlen(options) + 1);
+    
+    // Pick up where an interrupted run left off, if there is a checkpoint.
+    // Check the options before the output is cut back, so that resuming
+    // with different ones can't leave a file in two formats.
+    struct xrec_checkpoint checkpoint;
+    int resume = 0;
+    if (checkpoint_path != NULL) {
+        resume = read_checkpoint(checkpoint_path, &checkpoint);
+        if (resume < 0) {
+            return -1;
+        }
+        if (resume && checkpoint.options_hash != options_hash) {
+            printf("Checkpoint %s was made with different options\n", checkpoint_path);
+            return -1;
+        }
+    }
+    
+    // Open the output. When resuming, drop anything written after the
+    // checkpoint and carry on from there.
+    FILE * output = stdout;
+    if (output_path != NULL) {
+        output = fopen(output_path, resume ? "r+b" : "wb");
+        if (output == NULL ||
+            (resume && (ftruncate(fileno(output), (off_t)checkpoint.output_offset) != 0 ||
+                        fseek(output, 0, SEEK_END) != 0))) {
+            printf("Unable to open %s\n", output_path);
+            return -1;
+        }
+    }
+    
     // Set up the output state.
     struct srec_state write_state;
-    write_state.length = 0;
-    write_state.address = 0;
-    write_state.last_record_type = 0;
+    srec_begin_write(&write_state, write_file, output);
+    
+    // A binary record stream has no room for notes, so they all go to stderr.
+    struct xrec_bin_writer binary_state;
+    FILE * notes = output;
+    
+    struct convert_state convert;
+    convert.srec = &write_state;
+    convert.binary = NULL;
+    if (binary) {
+        xrec_bin_begin_write(&binary_state, write_binary, output, 1);
+        convert.binary = &binary_state;
+        notes = stderr;
+    }
+    convert.repair = repair;
+    convert.repaired_records = 0;
+    convert.failed_records = 0;
+    convert.expected_address = -1;
+    convert.index = NULL;
+    convert.index_error = 0;
+    convert.ring = NULL;
+    convert.checkpoint_at = 0;
+    convert.dedupe = NULL;
+    convert.held_termination = 0;
+    struct xrec_dedupe dedupe_tables;
+    if (dedupe) {
+        if (!xrec_dedupe_init(&dedupe_tables)) {
+            printf("Not enough memory to find duplicate records\n");
+            return -1;
+        }
+        convert.dedupe = &dedupe_tables;
+    }
+    convert.coverage = NULL;
+    if (coverage) {
+        convert.coverage = malloc(sizeof(struct xrec_coverage));
+        if (convert.coverage == NULL) {
+            printf("Not enough memory for coverage analysis\n");
+            return -1;
+        }
+        xrec_coverage_init(convert.coverage);
+    }
+    convert.fingerprint = NULL;
+    if (fingerprint) {
+        convert.fingerprint = malloc(sizeof(struct xrec_fingerprint));
+        if (convert.fingerprint == NULL) {
+            printf("Not enough memory to hash the image\n");
+            return -1;
+        }
+        xrec_fingerprint_init(convert.fingerprint);
+    }
+    struct xrec_index index;
+    xrec_index_init(&index);
+    if (index_path != NULL && !query) {
+        convert.index = &index;
+    }
     
     // Set up input state and read/write
     struct xrec_state read_state;
     xrec_begin_read(&read_state);
-    read_state.context = &write_state;
-    xrec_read_bytes(&read_state, (const char *)data, (int)bytes_read);
+    read_state.context = &convert;
+    read_state.filter_low = (uint16_t)filter_low;
+    read_state.filter_high = (uint16_t)filter_high;
+    if (resume && !restore_checkpoint(&checkpoint, &read_state, &convert)) {
+        printf("Invalid checkpoint file %s\n", checkpoint_path);
+        return -1;
+    }
+    
+    // In pipelined mode, records are formatted and written on a second thread,
+    // which hands the output to stdio in large blocks.
+    pthread_t writer;
+    if (pipeline) {
+        setvbuf(output, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+        // The ring keeps its counters on separate cache lines, so it must
+        // start on one. (Its size is already a multiple of its alignment.)
+        convert.ring = aligned_alloc(XREC_CACHE_LINE, sizeof(struct xrec_ring));
+        if (convert.ring == NULL) {
+            printf("Not enough memory for the pipeline\n");
+            return -1;
+        }
+        xrec_ring_init(convert.ring);
+        if (pthread_create(&writer, NULL, write_records, &convert) != 0) {
+            printf("Unable to start the writer thread\n");
+            return -1;
+        }
+    }
+    
+    struct xrec_alignment alignment = { 0, 0, 0 };
+    struct xrec_cache cache;
+    struct cached_output cached = { output, NULL };
+    char * notes_text = NULL;
+    size_t notes_length = 0;
+    if (wav) {
+        if (!read_wav(input_path, &read_state, notes)) {
+            return -1;
+        }
+    } else if (query) {
+        if (!read_indexed(index_path, input_path, (uint16_t)query_low, (uint16_t)query_high,
+                          &read_state, notes)) {
+            return -1;
+        }
+    } else if (merge) {
+        if (!read_captures(input_paths, input_count, &read_state, notes)) {
+            return -1;
+        }
+    } else if (pipeline && !align && cache_path == NULL) {
+        if (!read_streamed(input_path, &read_state)) {
+            return -1;
+        }
+    } else {
+        // Only the cache and checkpoints need the input's hash.
+        long bytes_read;
+        uint64_t hash = XREC_HASH_SEED;
+        int hashed = cache_path != NULL || checkpoint_path != NULL;
+        unsigned char * data = read_file(input_path, &bytes_read, hashed ? &hash : NULL);
+        if (data == NULL) {
+            return -1;
+        }
+        
+        // With a cache, the output depends only on the input and the options
+        // that change it. Serve a hit straight from the cache; on a miss,
+        // write the output as usual with a copy going into a new entry, so
+        // the output is complete even if the entry can't be stored. The notes
+        // are collected and written to both at the end.
+        if (cache_path != NULL) {
+            uint64_t cache_key = xrec_hash_bytes(hash, (const uint8_t *)options, strlen(options) + 1);
+            if (xrec_cache_fetch(&cache, cache_path, cache_key, output)) {
+                finish_pipeline(&convert, &writer);
+                free(data);
+                return 0;
+            }
+            FILE * collected = open_memstream(&notes_text, &notes_length);
+            cached.entry = collected != NULL ? xrec_cache_store_begin(&cache) : NULL;
+            if (cached.entry != NULL) {
+                write_state.sink = write_cached;
+                write_state.context = &cached;
+                notes = collected;
+            } else if (collected != NULL) {
+                fclose(collected);
+                free(notes_text);
+            }
+        }
+        
+        // Re-frame the input if it has lost its byte alignment.
+        if (align && xrec_align_detect(data, bytes_read, &alignment)) {
+            bytes_read = xrec_align_bytes(data, bytes_read, &alignment, data);
+        }
+        
+        // Split mode writes its own files, one per program.
+        if (split_prefix != NULL) {
+            int success = write_split(data, bytes_read, split_prefix, repair);
+            free(data);
+            return success ? 0 : -1;
+        }
+        
+        // With a checkpoint file, pause every so often at a record boundary
+        // to save progress.
+        long offset = 0;
+        if (resume) {
+            if (checkpoint.input_hash != hash || checkpoint.input_offset > (uint64_t)bytes_read) {
+                printf("Checkpoint %s does not match %s\n", checkpoint_path, input_path);
+                free(data);
+                return -1;
+            }
+            offset = (long)checkpoint.input_offset;
+        }
+        if (checkpoint_path != NULL) {
+            convert.checkpoint_at = read_state.position + CHECKPOINT_INTERVAL;
+        }
+        while (offset < bytes_read) {
+            // The parser takes an int count, so feed large inputs in chunks.
+            long count = bytes_read - offset;
+            if (count > PARSE_CHUNK_SIZE) {
+                count = PARSE_CHUNK_SIZE;
+            }
+            long consumed = xrec_read_bytes(&read_state, (const char *)data + offset, (int)count);
+            offset += consumed;
+            if (consumed < count) {
+                if (!write_checkpoint(checkpoint_path, &read_state, &convert, hash, options_hash, offset)) {
+                    fprintf(stderr, "Unable to write checkpoint %s\n", checkpoint_path);
+                }
+                convert.checkpoint_at = read_state.position + CHECKPOINT_INTERVAL;
+            }
+        }
+        free(data);
+    }
+    
+    if (convert.held_termination) {
+        deliver_record(&convert, XREC_TERMINATION_16BIT, 0, NULL, 0, 0);
+    }
+    finish_pipeline(&convert, &writer);
+    
+    // Don't lose a partial line when there was no termination record.
+    srec_flush(&write_state);
+    if (convert.binary != NULL && !xrec_bin_end_write(convert.binary)) {
+        fprintf(stderr, "Not enough memory to index the output; it was written without one.\n");
+    }
+    
+    if (convert.index != NULL) {
+        if (convert.index_error || !write_index(index_path, &index)) {
+            fprintf(notes, "\nWarning: unable to write index %s.\n", index_path);
+        }
+        xrec_index_free(&index);
+    }
     
     // Upon completion, display the stats and any error that occurred.
-    if (read_state.last_strict_error == XREC_ERROR_UNKNOWN_RECORD_TYPE) {
-        printf("\nWarning: input contained at least one unknown record type.\n");
-    } else if (read_state.last_strict_error == XREC_ERROR_INVALID_CHECKSUM) {
-        printf("\nWarning: input contained at least one failed data checksum. Beware corruption!\n");
+    if (alignment.bit_offset != 0 || alignment.inverted) {
+        fprintf(notes, "\nNote: input was realigned by %d bit(s)%s.\n",
+                alignment.bit_offset, alignment.inverted ? " with inverted polarity" : "");
+    }
+    if (filter) {
+        fprintf(notes, "\nNote: only data at $%04lX-$%04lX was converted.\n", filter_low, filter_high);
+    }
+    if (convert.coverage != NULL) {
+        write_coverage(notes, convert.coverage);
+        free(convert.coverage);
+    }
+    if (convert.fingerprint != NULL) {
+        uint32_t crc32;
+        uint64_t xxh64;
+        xrec_fingerprint_finish(convert.fingerprint, &crc32, &xxh64);
+        fprintf(notes, "\nNote: the loaded image has CRC-32 %08lX and XXH64 %016llX.\n",
+                (unsigned long)crc32, (unsigned long long)xxh64);
+        free(convert.fingerprint);
     }
-    if (write_state.last_record_type != XREC_TERMINATION_16BIT) {
-        printf("\nWarning: did not encounter (or emit) closing termination record.\n");
+    write_notes(notes, &read_state, &convert);
+    if (convert.dedupe != NULL) {
+        xrec_dedupe_free(convert.dedupe);
+    }
+    
+    if (cached.entry != NULL) {
+        fclose(notes);
+        fwrite(notes_text, 1, notes_length, output);
+        fwrite(notes_text, 1, notes_length, cached.entry);
+        free(notes_text);
+        if (!xrec_cache_store_end(&cache, XREC_CACHE_DEFAULT_SIZE)) {
+            fprintf(stderr, "Unable to store output in cache %s\n", cache_path);
+        }
+    }
+    if (output != stdout && fclose(output) != 0) {
+        printf("Error writing %s\n", output_path);
+        return -1;
+    }
+    
+    // The conversion is complete, so there's nothing left to resume.
+    if (checkpoint_path != NULL) {
+        remove(checkpoint_path);
     }
 }
 
-void flush_output(struct srec_state * srec)
+// Look for a correction to the record that just failed its checksum. Reports
+// the candidates on stderr and applies the best one in place if it is the
+// only one, or the only one that restores the expected address; the opcode
+// heuristic alone never decides. Returns nonzero if the record was repaired.
+int repair_record(struct xrec_state * xrec, struct convert_state * convert, uint16_t * address)
 {
-    if (srec->length == 0) {
-        return;
-    }
-    uint8_t output_count = 2 + srec->length + 1;
-    printf("S1%02X%04X", output_count, srec->address);
-    uint8_t sum = output_count + (srec->address >> 8) + (srec->address & 0xFF);
-    for (int i = 0; i < srec->length; i++) {
-        printf("%02X", srec->data[i]);
-        sum += srec->data[i];
+    struct xrec_repair_candidate candidates[MAX_REPAIR_CANDIDATES];
+    int found = xrec_repair_record(xrec->data, xrec->length, convert->expected_address,
+                                   candidates, MAX_REPAIR_CANDIDATES);
+    
+    fprintf(stderr, "Record at $%04X failed its checksum; %d candidate repair(s).\n", *address, found);
+    int shown = found < MAX_REPAIR_CANDIDATES ? found : MAX_REPAIR_CANDIDATES;
+    for (int i = 0; i < shown; i++) {
+        fprintf(stderr, "  score %3d:", candidates[i].score);
+        for (int j = 0; j < candidates[i].changes; j++) {
+            int offset = candidates[i].offset[j];
+            fprintf(stderr, " byte %d $%02X -> $%02X", offset, xrec->data[offset], candidates[i].value[j]);
+        }
+        fprintf(stderr, "\n");
     }
-    printf("%02X\n", (~sum & 0xFF));
     
-    // Update address to point to next implied address and reset length.
-    srec->address += srec->length;
-    srec->length = 0;
+    if (found == 0 || (found > 1 && (!candidates[0].continues || candidates[1].continues))) {
+        return 0;
+    }
+    xrec_repair_apply(xrec->data, &candidates[0]);
+    *address = (xrec->data[1] << 8) | xrec->data[2];
+    convert->repaired_records++;
+    fprintf(stderr, "  applied the first candidate.\n");
+    return 1;
+}
+
+// Write a record in the output format.
+void write_output(struct convert_state * convert, int record_type, uint16_t address,
+                  const uint8_t * data, int length, int checksum_error)
+{
+    if (convert->binary != NULL) {
+        xrec_bin_write_record(convert->binary, record_type, address, data, length, checksum_error);
+        // The notes check for the termination record here either way.
+        convert->srec->last_record_type = record_type;
+    } else {
+        srec_write_record(convert->srec, record_type, address, data, length);
+    }
+}
+
+// Hand a record to the writer, either directly or through the pipeline.
+void deliver_record(struct convert_state * convert, int record_type, uint16_t address,
+                    const uint8_t * data, int length, int checksum_error)
+{
+    if (convert->ring != NULL) {
+        struct xrec_record * record = xrec_ring_reserve(convert->ring);
+        record->type = record_type;
+        record->address = address;
+        record->length = length;
+        record->checksum_error = checksum_error;
+        if (length > 0) {
+            memcpy(record->data, data, length);
+        }
+        xrec_ring_publish(convert->ring);
+    } else {
+        write_output(convert, record_type, address, data, length, checksum_error);
+    }
 }
 
 // Required callback function for the parser
-extern void xrec_data_read(struct xrec_state * xrec,
-                           int record_type,
-                           uint16_t address,
-                           uint8_t * data,
-                           int length,
-                           int checksum_error)
+extern enum xrec_action xrec_data_read(struct xrec_state * xrec,
+                                       int record_type,
+                                       uint16_t address,
+                                       uint8_t * data,
+                                       int length,
+                                       int checksum_error)
 {
-    struct srec_state * srec = xrec->context;
+    struct convert_state * convert = xrec->context;
 
+    if (convert->index != NULL &&
+        !xrec_index_add(convert->index, xrec, record_type, address, length, checksum_error)) {
+        convert->index_error = 1;
+    }
     if (record_type == XREC_DATA_16BIT) {
         if (checksum_error) {
             // Don't print out this error because it will commingle with the
             // actual output. We will flag any strict errors at the end.
+            if (convert->repair) {
+                checksum_error = !repair_record(xrec, convert, &address);
+            }
         }
-        // If the address of the inbound record is not aligned with the presumed
-        // next address of the current outbound record, flush it.
-        if (address != srec->address + srec->length) {
-            flush_output(srec);
-            srec->address = address;
-        }
-        // Pour the inbound data into the outbound vessel.
-        for (int i = 0; i < length; i++) {
-            srec->data[srec->length++] = data[i];
-            // If we hit the end of this output line, flush it
-            // but keep on going.
-            if (srec->length == MAX_DATA_BYTES_PER_LINE) {
-                flush_output(srec);
+        convert->expected_address = (uint16_t)(address + length);
+    }
+    
+    if (convert->dedupe != NULL) {
+        if (record_type == XREC_DATA_16BIT) {
+            unsigned long failed_offset;
+            enum xrec_dedupe_result result = xrec_dedupe_check(convert->dedupe, xrec, address, data,
+                                                               length, checksum_error, &failed_offset);
+            if (result == XREC_DEDUPE_DUPLICATE) {
+                return XREC_CONTINUE;
+            }
+            if (result == XREC_DEDUPE_FIXED) {
+                convert->failed_records--;
+                fprintf(stderr, "Record at $%04X that failed its checksum at input offset %lu "
+                        "is replaced by the valid copy at offset %lu.\n",
+                        address, failed_offset, (unsigned long)xrec->record_offset);
             }
+        } else if (record_type == XREC_TERMINATION_16BIT) {
+            // A later copy may still replace a bad record, so the termination
+            // has to wait until the end of the input.
+            convert->held_termination = 1;
+            return XREC_CONTINUE;
         }
-    } else if (record_type == XREC_TERMINATION_16BIT) {
-        printf("S9030000FC\n");
-        
     }
-    srec->last_record_type = record_type;
+    
+    if (record_type == XREC_DATA_16BIT && checksum_error) {
+        convert->failed_records++;
+    }
+    if (convert->coverage != NULL && record_type == XREC_DATA_16BIT) {
+        xrec_coverage_add(convert->coverage, address, length);
+    }
+    if (convert->fingerprint != NULL && record_type == XREC_DATA_16BIT) {
+        xrec_fingerprint_add(convert->fingerprint, address, data, length);
+    }
+    deliver_record(convert, record_type, address, data, length, checksum_error);
+    
+    // Give the main loop a chance to take a checkpoint.
+    if (convert->checkpoint_at != 0 && xrec->position >= convert->checkpoint_at) {
+        return XREC_PAUSE;
+    }
+    return XREC_CONTINUE;
 }
-
@@ -9,7 +9,9 @@
  * Use and distribute freely, mark modified copies as such.
  */
 
+#include <stddef.h>
 #include "xrec.h"
+#include "xrec_kernels.h"
 
 #define XREC_START 'X'
 
@@ -22,9 +24,29 @@ enum xrec_read_state {
     READ_DATA,
     READ_CHECKSUM,
     READ_COMPLETE,
-    READ_ERROR
+    READ_ERROR,
+    READ_STOPPED    // A callback returned XREC_STOP
 };
 
+// Parser variants. Each public entry point passes one of these as a
+// constant, so the compiler generates a separate loop for each with the
+// checks that variant doesn't need removed.
+enum xrec_mode {
+    MODE_DEFAULT = 0,   // Forgiving, recording errors in last_strict_error
+    MODE_STRICT,        // Stop at the first error
+    MODE_LENIENT        // Forgiving, with no error bookkeeping
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+#define XREC_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define XREC_ALWAYS_INLINE inline
+#endif
+
+#ifdef XREC_COMPACT_STATE
+_Static_assert(sizeof(struct xrec_state) <= 64, "compact xrec_state must fit in a cache line");
+#endif
+
 void
 xrec_begin_read (struct xrec_state *xrec) {
     xrec->read_state = READ_WAIT_FOR_START;
@@ -32,16 +54,85 @@ xrec_begin_read (struct xrec_state *xrec) {
     xrec->byte_count = 0;
     xrec->length = 0;
     xrec->last_strict_error = XREC_ERROR_NONE;
+    xrec->position = 0;
+    xrec->record_offset = 0;
+    xrec->callback = NULL;
+    xrec->filter_low = 0x0000;
+    xrec->filter_high = 0xFFFF;
+#ifdef XREC_COMPACT_STATE
+    xrec->data = NULL;
+#endif
 }
 
-void
-xrec_read_byte (struct xrec_state *xrec, char byte) {
-    uint8_t b = (uint8_t)byte;
+// Deliver a finished record to the callback and reset for the next one.
+// Returns nonzero if the parser must return to its caller.
+static XREC_ALWAYS_INLINE int
+xrec_complete_record (struct xrec_state *xrec, const enum xrec_mode mode) {
+    // Get the address into a single value. It occupies bytes two and three
+    // of the data.
+    uint16_t address = (xrec->data[1] << 8) | (xrec->data[2]);
+    int checksum = 0;
+    if (xrec->type == XREC_DATA_16BIT) {
+        // Compute the checksum across the buffer so far, ignoring
+        // rollover/carry.
+        uint8_t sum = xrec_kernels->sum(xrec->data, xrec->length - 1);
+        // Checksum is the one's complement of the lower byte of the sum.
+        uint8_t invsum = ~sum;
+        uint8_t lastbyte = xrec->data[xrec->length - 1];
+        checksum = lastbyte - invsum;
+        if (checksum != 0 && mode != MODE_LENIENT) {
+            xrec->last_strict_error = XREC_ERROR_INVALID_CHECKSUM;
+        }
+    }
+    
+    // Trim data records to the filter range. Those wholly outside it have
+    // been checked but aren't delivered.
+    uint8_t *payload = &xrec->data[3];
+    int length = xrec->byte_count;
+    int deliver = 1;
+    if (xrec->type == XREC_DATA_16BIT && (xrec->filter_low != 0x0000 || xrec->filter_high != 0xFFFF)) {
+        uint32_t first = address;
+        uint32_t last = first + length - 1;     // Bytes past $FFFF count as above the range.
+        if (last < xrec->filter_low || first > xrec->filter_high) {
+            deliver = 0;
+        } else {
+            int skip_front = first < xrec->filter_low ? (int)(xrec->filter_low - first) : 0;
+            int skip_back = last > xrec->filter_high ? (int)(last - xrec->filter_high) : 0;
+            address += skip_front;
+            payload += skip_front;
+            length -= skip_front + skip_back;
+        }
+    }
+    
+    // A strict parser never delivers a bad record.
+    enum xrec_action action = XREC_CONTINUE;
+    if (mode == MODE_STRICT && checksum != 0) {
+        action = XREC_PAUSE;
+    } else if (deliver) {
+        xrec_callback_t callback = xrec->callback ? xrec->callback : xrec_data_read;
+        action = callback(xrec, xrec->type, address, payload, length, checksum != 0);
+    }
+    
+    // Reset the state.
+    xrec->read_state = action == XREC_STOP ? READ_STOPPED : READ_WAIT_FOR_START;
+    xrec->type = 0;
+    xrec->byte_count = 0;
+    xrec->length = 0;
+    return action != XREC_CONTINUE;
+}
+
+#ifndef XREC_TABLE_DRIVEN
+
+// Consume one byte. Returns nonzero if the parser must return to its caller.
+static XREC_ALWAYS_INLINE int
+xrec_step (struct xrec_state *xrec, uint8_t b, const enum xrec_mode mode) {
+    unsigned long position = xrec->position++;
 
     switch (xrec->read_state) {
         case READ_WAIT_FOR_START:
         {
             if (b == XREC_START) {
+                xrec->record_offset = position;
                 xrec->read_state = READ_RECORD_TYPE;
             } else {
                 // Ignore this byte. Remain in the wait state.
@@ -59,8 +150,13 @@ xrec_read_byte (struct xrec_state *xrec, char byte) {
             } else {
                 // Anything else is who knows, so revert to the wait state
                 // to try to re-sync.
-                xrec->last_strict_error = XREC_ERROR_UNKNOWN_RECORD_TYPE;
+                if (mode != MODE_LENIENT) {
+                    xrec->last_strict_error = XREC_ERROR_UNKNOWN_RECORD_TYPE;
+                }
                 xrec->read_state = READ_WAIT_FOR_START;
+                if (mode == MODE_STRICT) {
+                    return 1;
+                }
             }
             break;
         }
@@ -96,44 +192,144 @@ xrec_read_byte (struct xrec_state *xrec, char byte) {
         }
     }
     
+    
     // If we have reached either terminal state, invoke the appropriate callback.
     if (xrec->read_state == READ_COMPLETE) {
-        // Get the address into a single value. It occupies bytes two and three
-        // of the data.
-        uint16_t address = (xrec->data[1] << 8) | (xrec->data[2]);
-        int checksum = 0;
-        if (xrec->type == XREC_DATA_16BIT) {
-            // Compute the checksum across the buffer so far. Use an unsigned
-            // value to accumulate and ignore rollover/carry.
-            uint8_t sum = 0;
-            for (int i = 0; i < xrec->length - 1; i++) {
-                sum += xrec->data[i];
-            }
-            // Checksum is the one's complement of the lower byte of the sum.
-            uint8_t invsum = ~sum;
-            uint8_t lastbyte = xrec->data[xrec->length - 1];
-            checksum = lastbyte - invsum;
-            if (checksum != 0) {
-                xrec->last_strict_error = XREC_ERROR_INVALID_CHECKSUM;
+        return xrec_complete_record(xrec, mode);
+    }
+    return 0;
+}
+
+#else
+
+// Table-driven core, selected by compiling with XREC_TABLE_DRIVEN. Each
+// byte is classified once, the next state comes from a table, and the field
+// updates are written so that they compile to conditional moves rather than
+// branches. The only branch left in the common path is taken once per record.
+
+enum xrec_byte_class {
+    CLASS_OTHER = 0,
+    CLASS_START,
+    CLASS_DATA_TYPE,
+    CLASS_TERMINATION_TYPE,
+    CLASS_COUNT
+};
+
+static const uint8_t xrec_byte_class[256] = {
+    [XREC_START] = CLASS_START,
+    ['1'] = CLASS_DATA_TYPE,
+    ['9'] = CLASS_TERMINATION_TYPE
+};
+
+static const uint8_t xrec_next_state[READ_COMPLETE][CLASS_COUNT] = {
+    [READ_WAIT_FOR_START]   = { READ_WAIT_FOR_START, READ_RECORD_TYPE, READ_WAIT_FOR_START, READ_WAIT_FOR_START },
+    [READ_RECORD_TYPE]      = { READ_WAIT_FOR_START, READ_WAIT_FOR_START, READ_COUNT, READ_COMPLETE },
+    [READ_COUNT]            = { READ_ADDRESS_HIGH, READ_ADDRESS_HIGH, READ_ADDRESS_HIGH, READ_ADDRESS_HIGH },
+    [READ_ADDRESS_HIGH]     = { READ_ADDRESS_LOW, READ_ADDRESS_LOW, READ_ADDRESS_LOW, READ_ADDRESS_LOW },
+    [READ_ADDRESS_LOW]      = { READ_DATA, READ_DATA, READ_DATA, READ_DATA },
+    [READ_DATA]             = { READ_DATA, READ_DATA, READ_DATA, READ_DATA },
+    [READ_CHECKSUM]         = { READ_COMPLETE, READ_COMPLETE, READ_COMPLETE, READ_COMPLETE }
+};
+
+// Nonzero for the states whose byte is kept in the record buffer.
+static const uint8_t xrec_stores_byte[READ_COMPLETE] = {
+    [READ_COUNT] = 1, [READ_ADDRESS_HIGH] = 1, [READ_ADDRESS_LOW] = 1,
+    [READ_DATA] = 1, [READ_CHECKSUM] = 1
+};
+
+static const uint8_t xrec_type_for_class[CLASS_COUNT] = {
+    [CLASS_DATA_TYPE] = XREC_DATA_16BIT,
+    [CLASS_TERMINATION_TYPE] = XREC_TERMINATION_16BIT
+};
+
+// Consume one byte. Returns nonzero if the parser must return to its caller.
+static XREC_ALWAYS_INLINE int
+xrec_step (struct xrec_state *xrec, uint8_t b, const enum xrec_mode mode) {
+    unsigned long position = xrec->position++;
+    int state = xrec->read_state;
+    int class = xrec_byte_class[b];
+    int next = xrec_next_state[state][class];
+
+    // The buffer always has room for one more byte until a record completes,
+    // so store unconditionally and only advance the length when it counts.
+    xrec->data[xrec->length] = b;
+    xrec->length += xrec_stores_byte[state];
+
+    xrec->record_offset = state == READ_WAIT_FOR_START ? position : xrec->record_offset;
+    xrec->type = state == READ_RECORD_TYPE ? xrec_type_for_class[class] : xrec->type;
+    xrec->byte_count = state == READ_COUNT ? b + 1 : xrec->byte_count - (state == READ_DATA);
+    next += state == READ_DATA && xrec->byte_count == 0;    // On to READ_CHECKSUM
+    xrec->read_state = next;
+    if (mode != MODE_LENIENT && state == READ_RECORD_TYPE && next == READ_WAIT_FOR_START) {
+        xrec->last_strict_error = XREC_ERROR_UNKNOWN_RECORD_TYPE;
+        if (mode == MODE_STRICT) {
+            return 1;
+        }
+    }
+
+    if (next == READ_COMPLETE) {
+        // Restore the byte count to the payload length.
+        xrec->byte_count = xrec->type == XREC_DATA_16BIT ? xrec->length - 2 - 1 - 1 : 0;
+        return xrec_complete_record(xrec, mode);
+    }
+    return 0;
+}
+
+#endif
+
+// Consume up to `count` bytes, returning how many were consumed.
+static XREC_ALWAYS_INLINE int
+xrec_read_bytes_mode (struct xrec_state * restrict xrec,
+                      const char * restrict data,
+                      int count,
+                      const enum xrec_mode mode) {
+    if (xrec->read_state == READ_STOPPED) {
+        return 0;
+    }
+    int remaining = count;
+    while (remaining > 0) {
+        // Between records, skip straight to the next start token.
+        if (xrec->read_state == READ_WAIT_FOR_START) {
+            size_t skip = xrec_kernels->find((const uint8_t *)data, remaining, XREC_START);
+            xrec->position += skip;
+            data += skip;
+            remaining -= (int)skip;
+            if (remaining == 0) {
+                break;
             }
         }
-        
-        xrec_data_read(xrec, xrec->type, address, &xrec->data[3], xrec->byte_count, checksum != 0);
-        
-        // Reset the state.
-        xrec->read_state = READ_WAIT_FOR_START;
-        xrec->type = 0;
-        xrec->byte_count = 0;
-        xrec->length = 0;
+        --remaining;
+        if (xrec_step(xrec, (uint8_t)*data++, mode)) {
+            break;
+        }
     }
+    return count - remaining;
 }
 
 void
+xrec_read_byte (struct xrec_state *xrec, char byte) {
+    if (xrec->read_state != READ_STOPPED) {
+        (void)xrec_step(xrec, (uint8_t)byte, MODE_DEFAULT);
+    }
+}
+
+int
 xrec_read_bytes (struct xrec_state * restrict xrec,
                  const char * restrict data,
                  int count) {
-    while (count > 0) {
-        xrec_read_byte(xrec, *data++);
-        --count;
-    }
+    return xrec_read_bytes_mode(xrec, data, count, MODE_DEFAULT);
+}
+
+int
+xrec_read_bytes_strict (struct xrec_state * restrict xrec,
+                        const char * restrict data,
+                        int count) {
+    return xrec_read_bytes_mode(xrec, data, count, MODE_STRICT);
+}
+
+int
+xrec_read_bytes_lenient (struct xrec_state * restrict xrec,
+                         const char * restrict data,
+                         int count) {
+    return xrec_read_bytes_mode(xrec, data, count, MODE_LENIENT);
 }
@@ -26,22 +26,51 @@
  *
  * An optional void * "context" field is provided in the state structure in case
  * the caller needs to associate the callback with any particular object.
+ * Likewise, an optional "callback" field may be set after `xrec_begin_read`
+ * to route the records of one particular parser to a different function than
+ * the global `xrec_data_read`. This lets several parsers with different
+ * consumers coexist in the same program.
+ *
+ * When compiled with XREC_COMPACT_STATE the structure shrinks to one cache
+ * line and the "data" field becomes a pointer, which must be set after
+ * `xrec_begin_read` to a buffer of XREC_RECORD_SIZE bytes. A parser only
+ * uses its buffer between the start of a record and its delivery, so
+ * parsers that are never left part way through a record (e.g. ones always
+ * fed whole captures) may share one buffer.
+ *
+ * To extract only part of the address space, set "filter_low" and
+ * "filter_high" after `xrec_begin_read` (they default to $0000-$FFFF). Data
+ * records are still checked in full, but those wholly outside the range are
+ * not delivered, and those that overlap it are trimmed to it, so the
+ * callback sees only the data that falls within the range. The raw record in
+ * the "data" field is left untrimmed.
+ *
+ * The "record_offset" field gives the position in the input (counting from
+ * the first byte read after `xrec_begin_read`) of the "X" that started the
+ * record being delivered, which is useful for indexing the input.
  *
  * The callbacks must be provided by the user, e.g., as follows:
  *
- *      void xrec_data_read (struct xrec_state *xrec,
- *                           int record_type,
- *                           uint16_t address,
- *                           uint8_t *data,
- *                           int length, int checksum_error) {
+ *      enum xrec_action xrec_data_read (struct xrec_state *xrec,
+ *                                       int record_type,
+ *                                       uint16_t address,
+ *                                       uint8_t *data,
+ *                                       int length, int checksum_error) {
  *          if (record_type == XREC_DATA_16BIT && !checksum_error) {
  *              (void) fseek(outfile, address, SEEK_SET);
  *              (void) fwrite(data, 1, length, outfile);
  *          } else if (record_type == XREC_TERMINATION_16BIT) {
  *              (void) fclose(outfile);
  *          }
+ *          return XREC_CONTINUE;
  *      }
  *
+ * A callback that can't accept any more for now (e.g. because its output
+ * queue is full) can return XREC_PAUSE. `xrec_read_bytes` then returns
+ * straight away with the number of bytes it consumed, and the caller passes
+ * the remainder in again when it is ready. A callback that has everything it
+ * wants can return XREC_STOP to have all further input ignored.
+ *
  * The library is quite forgiving, and has no error modes that stop its
  * processing. Data that doesn't begin with the X1/X9 start tokens will
  * generally be ignored, but of course feeding the parser garbage might
@@ -54,6 +83,12 @@
  *          (b) ensure that the xrec->read_state field is clear (0) and
  *          (c) ensure that the final record read out was a termination.
  *
+ * Two specialized variants of `xrec_read_bytes` are also available, each
+ * compiled with only the checks it needs in its inner loop.
+ * `xrec_read_bytes_strict` stops at the first error (which makes (a) above
+ * a simple check of its return value), and `xrec_read_bytes_lenient` skips
+ * the error bookkeeping entirely for best-effort dumps.
+ *
  */
 
 #ifndef XREC_H
@@ -72,26 +107,95 @@ enum xrec_error {
     XREC_ERROR_INVALID_CHECKSUM
 };
 
+// What the parser should do once a callback returns.
+enum xrec_action {
+    XREC_CONTINUE = 0,  // Carry on parsing
+    XREC_PAUSE,         // Return now; the rest of the input may be passed in later
+    XREC_STOP           // Return now and ignore any further input
+};
+
+struct xrec_state;
+
+// Per-state callback, with the same arguments as `xrec_data_read` below.
+typedef enum xrec_action (*xrec_callback_t)(struct xrec_state *xrec,
+                                int record_type,
+                                uint16_t address,
+                                uint8_t *data,
+                                int length,
+                                int checksum_error);
+
+// Size of the record buffer: the count, address, data, and checksum.
+#define XREC_RECORD_SIZE    (1 + 2 + 256 + 1)
+
+#ifndef XREC_COMPACT_STATE
+
 typedef struct xrec_state {
     int             read_state;
     int             type;
     int             byte_count;
     int             length;
-    uint8_t         data[1 + 2 + 256 + 1];  // This buffer contains the count, address, data, and checksum.
+    uint8_t         data[XREC_RECORD_SIZE];
     enum xrec_error last_strict_error;
+    unsigned long   position;       // Bytes read since xrec_begin_read.
+    unsigned long   record_offset;  // Position of the current record's start token.
     void *          context;
+    xrec_callback_t callback;   // Optional. If NULL, `xrec_data_read` is called.
+    uint16_t        filter_low;     // Only data at these addresses is delivered.
+    uint16_t        filter_high;
 } xrec_t;
 
+#else
+
+// Compact layout, selected by compiling everything with XREC_COMPACT_STATE,
+// for programs that keep thousands of parsers alive at once. The fields are
+// as narrow as they can be and the record buffer is the caller's, so the
+// state fits in a single 64-byte cache line. `position` and `record_offset`
+// wrap at 4 GB.
+typedef struct xrec_state {
+    uint8_t *       data;           // XREC_RECORD_SIZE bytes, set after xrec_begin_read.
+    void *          context;
+    xrec_callback_t callback;   // Optional. If NULL, `xrec_data_read` is called.
+    uint32_t        position;       // Bytes read since xrec_begin_read.
+    uint32_t        record_offset;  // Position of the current record's start token.
+    uint16_t        byte_count;
+    uint16_t        length;
+    uint16_t        filter_low;     // Only data at these addresses is delivered.
+    uint16_t        filter_high;
+    uint8_t         read_state;
+    uint8_t         type;
+    uint8_t         last_strict_error;
+} xrec_t;
+
+#endif
+
 // Begin reading
 void xrec_begin_read(struct xrec_state *xrec);
 
-// Read a single character
+// Read a single character. A callback may stop the parser here, but pausing
+// has no effect.
 void xrec_read_byte(struct xrec_state *xrec, char chr);
 
-// Read `count` characters from `data`
-void xrec_read_bytes(struct xrec_state * restrict xrec,
-                     const char * restrict data,
-                     int count);
+// Read `count` characters from `data`. Returns the number of characters
+// consumed, which is less than `count` only if the callback paused or
+// stopped the parser.
+int xrec_read_bytes(struct xrec_state * restrict xrec,
+                    const char * restrict data,
+                    int count);
+
+// Read `count` characters from `data` strictly: stop at the first unknown
+// record type or checksum error, leaving it in `last_strict_error`. A record
+// that fails its checksum is not delivered. Returns the number of characters
+// consumed, including the one at which an error was found. The callback may
+// pause or stop the parser as with `xrec_read_bytes`.
+int xrec_read_bytes_strict(struct xrec_state * restrict xrec,
+                           const char * restrict data,
+                           int count);
+
+// Read `count` characters from `data` on a best-effort basis, exactly like
+// `xrec_read_bytes` but without maintaining `last_strict_error`.
+int xrec_read_bytes_lenient(struct xrec_state * restrict xrec,
+                            const char * restrict data,
+                            int count);
 
 // Callback - this must be provided by the user of the library.
 // The arguments are as follows:
@@ -102,10 +206,14 @@ void xrec_read_bytes(struct xrec_state * restrict xrec,
 //      length          - Length of data payload
 //      checksum_error  - Nonzero if this record uses a checksum and it doesn't match
 //
+// The return value tells the parser whether to carry on (XREC_CONTINUE),
+// return to its caller straight after this record (XREC_PAUSE), or return
+// and ignore all further input until the next `xrec_begin_read` (XREC_STOP).
+//
 // Note that while the interpreted record is passed entirely as arguments,
 // the raw data is available in the `xrec` structure, which includes the
 // address and checksum as part of data.
-extern void xrec_data_read(struct xrec_state *xrec,
+extern enum xrec_action xrec_data_read(struct xrec_state *xrec,
                            int record_type,
                            uint16_t address,
                            uint8_t *data,
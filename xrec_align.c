@@ -0,0 +1,99 @@
+/*
+ * xrec_align.c
+ *
+ * Bit-alignment search for xrec captures that have lost their byte framing.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include "xrec.h"
+#include "xrec_align.h"
+#include "xrec_kernels.h"
+
+#define ALIGN_OFFSETS       8
+#define ALIGN_CANDIDATES    (ALIGN_OFFSETS * 2)
+#define ALIGN_CHUNK_SIZE    4096
+
+static enum xrec_action
+count_valid_record (struct xrec_state *xrec,
+                    int record_type,
+                    uint16_t address,
+                    uint8_t *data,
+                    int length,
+                    int checksum_error) {
+    long *valid_records = xrec->context;
+    (void)address;
+    (void)data;
+    (void)length;
+    if (record_type == XREC_DATA_16BIT && !checksum_error) {
+        ++*valid_records;
+    }
+    return XREC_CONTINUE;
+}
+
+int
+xrec_align_detect (const uint8_t *data, long length,
+                   struct xrec_alignment *result) {
+    struct xrec_state candidates[ALIGN_CANDIDATES];
+    long valid_records[ALIGN_CANDIDATES];
+    uint8_t chunk[ALIGN_CHUNK_SIZE];
+#ifdef XREC_COMPACT_STATE
+    // The candidates are fed a chunk at a time in turn, so each needs its own.
+    uint8_t records[ALIGN_CANDIDATES][XREC_RECORD_SIZE];
+#endif
+
+    for (int c = 0; c < ALIGN_CANDIDATES; c++) {
+        valid_records[c] = 0;
+        xrec_begin_read(&candidates[c]);
+#ifdef XREC_COMPACT_STATE
+        candidates[c].data = records[c];
+#endif
+        candidates[c].context = &valid_records[c];
+        candidates[c].callback = count_valid_record;
+    }
+
+    // Work through the input a cache-sized chunk at a time: realign the
+    // chunk for each candidate in turn and hand it to that candidate's
+    // parser whole, so the input is only read from memory once.
+    for (long i = 0; i < length; i += ALIGN_CHUNK_SIZE) {
+        long count = length - i;
+        if (count > ALIGN_CHUNK_SIZE) {
+            count = ALIGN_CHUNK_SIZE;
+        }
+        for (int c = 0; c < ALIGN_CANDIDATES; c++) {
+            int k = c % ALIGN_OFFSETS;
+            // The final byte only exists whole at offset zero.
+            long produced = k && i + count == length ? count - 1 : count;
+            xrec_kernels->realign(chunk, data + i, (size_t)produced, k,
+                                  c >= ALIGN_OFFSETS ? 0xFF : 0);
+            xrec_read_bytes(&candidates[c], (const char *)chunk, (int)produced);
+        }
+    }
+
+    // Prefer the unmodified input on ties, then lower offsets.
+    int best = 0;
+    for (int c = 1; c < ALIGN_CANDIDATES; c++) {
+        if (valid_records[c] > valid_records[best]) {
+            best = c;
+        }
+    }
+    result->bit_offset = best % ALIGN_OFFSETS;
+    result->inverted = best >= ALIGN_OFFSETS;
+    result->valid_records = valid_records[best];
+    return valid_records[best] > 0;
+}
+
+long
+xrec_align_bytes (const uint8_t *data, long length,
+                  const struct xrec_alignment *alignment,
+                  uint8_t *out) {
+    int k = alignment->bit_offset;
+    long produced = k ? length - 1 : length;
+    if (produced <= 0) {
+        return 0;
+    }
+    xrec_kernels->realign(out, data, (size_t)produced, k, alignment->inverted ? 0xFF : 0);
+    return produced;
+}
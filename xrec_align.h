@@ -0,0 +1,55 @@
+/*
+ * xrec_align.h
+ *
+ * Bit-alignment search for xrec captures that have lost their byte framing,
+ * e.g. cassette tapes digitized starting partway through a byte.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * The input is treated as one continuous bitstream, most significant bit of
+ * each byte first. The search tries every bit offset (0-7) in both normal and
+ * inverted polarity and keeps whichever alignment yields the most X1 records
+ * with valid checksums:
+ *
+ *      struct xrec_alignment alignment;
+ *      if (xrec_align_detect(input, length, &alignment)) {
+ *          length = xrec_align_bytes(input, length, &alignment, input);
+ *      }
+ *      xrec_read_bytes(&xrec, (const char *)input, (int)length);
+ *
+ * All sixteen candidates are scored in a single pass over the input, each
+ * with its own xrec_state. Each chunk of input is shifted into place with the
+ * `realign` kernel (vectorized where the CPU allows; see xrec_kernels.h) and
+ * parsed in bulk for every candidate while it is still in cache.
+ */
+
+#ifndef XREC_ALIGN_H
+#define XREC_ALIGN_H
+
+#include <stdint.h>
+
+struct xrec_alignment {
+    int     bit_offset;     // Number of leading bits to skip (0-7).
+    int     inverted;       // Nonzero if every bit must be complemented.
+    long    valid_records;  // X1 records with a valid checksum at this alignment.
+};
+
+// Score all alignments of `data` and store the best one in `result`. Returns
+// nonzero if any alignment produced at least one valid data record; if none
+// did, `result` describes the unmodified input.
+int xrec_align_detect(const uint8_t *data, long length,
+                      struct xrec_alignment *result);
+
+// Write `data` re-framed according to `alignment` into `out`, which may be
+// the same buffer as `data`. Returns the number of whole bytes produced,
+// which is one less than `length` when a bit offset is applied.
+long xrec_align_bytes(const uint8_t *data, long length,
+                      const struct xrec_alignment *alignment,
+                      uint8_t *out);
+
+#endif
@@ -0,0 +1,276 @@
+//
+//  xrec_bench.c
+//
+//  Throughput benchmark for the xrec parser core. Reports time, cycles and
+//  branch mispredictions per input byte on a clean and a noisy corpus.
+//
+//  Build once per parser core to compare them, e.g.:
+//
+//      cc -O2 xrec_bench.c xrec.c xrec_kernels.c -o xrec_bench
+//      cc -O2 -DXREC_TABLE_DRIVEN xrec_bench.c xrec.c xrec_kernels.c -o xrec_bench_table
+//
+//  The kernels are chosen for the CPU as in xrec2srec, and the XREC_KERNEL
+//  environment variable can force a particular set ("scalar", "sse2",
+//  "avx2" or "avx512") for comparison.
+//
+//  A third run feeds the clean corpus through many parsers at once, a small
+//  chunk to each in turn, to show how the size of the parser state affects
+//  cache behavior. Build with -DXREC_COMPACT_STATE to compare the compact
+//  layout.
+//
+//  Cycle, branch-miss and cache-miss counts come from the Linux perf counters, and are
+//  shown as "n/a" where those are unavailable.
+//
+// Copyright (c) 2022 Ben Zotto
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "xrec.h"
+#include "xrec_kernels.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define CORPUS_SIZE     (16 * 1024 * 1024)
+#define REPEATS         5
+#define STREAMS         4096
+#define STREAM_CHUNK    16
+
+#ifdef XREC_TABLE_DRIVEN
+#define CORE_NAME       "table-driven"
+#else
+#define CORE_NAME       "switch"
+#endif
+
+#ifdef XREC_COMPACT_STATE
+#define STATE_NAME      "compact"
+#else
+#define STATE_NAME      "standard"
+#endif
+
+struct counters {
+    int cycles;         // perf event file descriptors, or -1
+    int branch_misses;
+    int cache_misses;
+};
+
+static unsigned long records_seen;
+
+// Required callback function for the parser
+enum xrec_action xrec_data_read(struct xrec_state * xrec,
+                                int record_type,
+                                uint16_t address,
+                                uint8_t * data,
+                                int length,
+                                int checksum_error)
+{
+    (void)xrec;
+    (void)record_type;
+    (void)address;
+    (void)data;
+    (void)length;
+    (void)checksum_error;
+    records_seen++;
+    return XREC_CONTINUE;
+}
+
+// A simple xorshift generator so that corpora are identical from run to run.
+static uint32_t random_state = 2463534242u;
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+// Well-formed records of random sizes separated by short leaders.
+static void make_clean_corpus(uint8_t * corpus, size_t size)
+{
+    size_t i = 0;
+    uint16_t address = 0;
+    while (i + 2 + 1 + 2 + 256 + 1 + 8 < size) {
+        int length = 1 + next_random() % 256;
+        uint8_t sum = 0;
+        corpus[i++] = 'X';
+        corpus[i++] = '1';
+        sum += corpus[i++] = (uint8_t)(length - 1);
+        sum += corpus[i++] = (uint8_t)(address >> 8);
+        sum += corpus[i++] = (uint8_t)address;
+        for (int j = 0; j < length; j++) {
+            sum += corpus[i++] = (uint8_t)next_random();
+        }
+        corpus[i++] = (uint8_t)~sum;
+        for (int j = next_random() % 8; j > 0; j--) {
+            corpus[i++] = 0xFF;
+        }
+        address += length;
+    }
+    memset(corpus + i, 0xFF, size - i);
+}
+
+// The clean corpus with a few percent of bytes replaced, many of them by
+// the start and type tokens so that the parser keeps losing and regaining
+// sync.
+static void make_noisy_corpus(uint8_t * corpus, size_t size)
+{
+    static const uint8_t tokens[] = { 'X', '1', '9' };
+    make_clean_corpus(corpus, size);
+    for (size_t n = size / 32; n > 0; n--) {
+        uint32_t r = next_random();
+        corpus[next_random() % size] = (r & 1) ? tokens[(r >> 1) % 3] : (uint8_t)(r >> 8);
+    }
+}
+
+enum counter_event {
+    EVENT_CYCLES,
+    EVENT_BRANCH_MISSES,
+    EVENT_CACHE_MISSES
+};
+
+static int open_counter(enum counter_event event)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = event == EVENT_CYCLES ? PERF_COUNT_HW_CPU_CYCLES :
+                  event == EVENT_BRANCH_MISSES ? PERF_COUNT_HW_BRANCH_MISSES :
+                  PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    (void)event;
+    return -1;
+#endif
+}
+
+static void control_counter(int fd, int enable)
+{
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, enable ? PERF_EVENT_IOC_RESET : PERF_EVENT_IOC_DISABLE, 0);
+        if (enable) {
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    (void)fd;
+    (void)enable;
+#endif
+}
+
+static long long read_counter(int fd)
+{
+    long long value = -1;
+#ifdef __linux__
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+        value = -1;
+    }
+#else
+    (void)fd;
+#endif
+    return value;
+}
+
+static void print_per_byte(long long count, double bytes)
+{
+    if (count < 0) {
+        printf("  %10s", "n/a");
+    } else {
+        printf("  %10.4f", count / bytes);
+    }
+}
+
+// Parse the corpus split evenly between `streams` parsers. With more than
+// one, each parser is given STREAM_CHUNK bytes in turn.
+static void run(const char * name, const uint8_t * corpus, size_t size,
+                int streams, struct counters * counters)
+{
+    struct xrec_state * xrec = calloc(streams, sizeof(*xrec));
+#ifdef XREC_COMPACT_STATE
+    uint8_t * buffers = malloc((size_t)streams * XREC_RECORD_SIZE);
+#endif
+    size_t slice = size / streams;
+    size_t chunk = streams == 1 ? slice : STREAM_CHUNK;
+    struct timespec start, end;
+
+    records_seen = 0;
+    control_counter(counters->cycles, 1);
+    control_counter(counters->branch_misses, 1);
+    control_counter(counters->cache_misses, 1);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < REPEATS; r++) {
+        for (int s = 0; s < streams; s++) {
+            xrec_begin_read(&xrec[s]);
+#ifdef XREC_COMPACT_STATE
+            xrec[s].data = buffers + (size_t)s * XREC_RECORD_SIZE;
+#endif
+        }
+        for (size_t offset = 0; offset < slice; offset += chunk) {
+            int count = (int)(slice - offset < chunk ? slice - offset : chunk);
+            for (int s = 0; s < streams; s++) {
+                xrec_read_bytes(&xrec[s], (const char *)corpus + s * slice + offset, count);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    control_counter(counters->cycles, 0);
+    control_counter(counters->branch_misses, 0);
+    control_counter(counters->cache_misses, 0);
+
+    double bytes = (double)slice * streams * REPEATS;
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-8s  %10.4f  %10.1f", name, seconds * 1e9 / bytes, bytes / seconds / 1e6);
+    print_per_byte(read_counter(counters->cycles), bytes);
+    print_per_byte(read_counter(counters->branch_misses), bytes);
+    print_per_byte(read_counter(counters->cache_misses), bytes);
+    printf("  %10lu\n", records_seen / REPEATS);
+
+#ifdef XREC_COMPACT_STATE
+    free(buffers);
+#endif
+    free(xrec);
+}
+
+int main(void)
+{
+    const char * kernel = getenv("XREC_KERNEL");
+    if (!xrec_kernels_init(kernel)) {
+        printf("Kernel set %s is unknown or not supported on this CPU\n", kernel);
+        return -1;
+    }
+    uint8_t * corpus = malloc(CORPUS_SIZE);
+    if (corpus == NULL) {
+        printf("Not enough memory for the corpus\n");
+        return -1;
+    }
+    struct counters counters;
+    counters.cycles = open_counter(EVENT_CYCLES);
+    counters.branch_misses = open_counter(EVENT_BRANCH_MISSES);
+    counters.cache_misses = open_counter(EVENT_CACHE_MISSES);
+
+    printf("%s parser core, %s kernels, %s state (%zu bytes), %d MB corpus x %d\n",
+           CORE_NAME, xrec_kernels->name, STATE_NAME, sizeof(struct xrec_state),
+           CORPUS_SIZE / (1024 * 1024), REPEATS);
+    printf("%-8s  %10s  %10s  %10s  %10s  %10s  %10s\n",
+           "corpus", "ns/byte", "MB/s", "cycles/B", "br-miss/B", "$-miss/B", "records");
+    make_clean_corpus(corpus, CORPUS_SIZE);
+    run("clean", corpus, CORPUS_SIZE, 1, &counters);
+    run("streams", corpus, CORPUS_SIZE, STREAMS, &counters);
+    make_noisy_corpus(corpus, CORPUS_SIZE);
+    run("noisy", corpus, CORPUS_SIZE, 1, &counters);
+
+    free(corpus);
+    return 0;
+}
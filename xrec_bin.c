@@ -0,0 +1,230 @@
+/*
+ * xrec_bin.c
+ *
+ * A compact binary record stream.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xrec_bin.h"
+#include "xrec_kernels.h"
+
+#define XREC_BIN_MAGIC          "XRBS"
+#define XREC_BIN_INDEX_MAGIC    "XRBI"
+#define MAX_PAYLOAD             256
+#define INITIAL_ENTRIES         1024
+
+static uint8_t *
+put_le (uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+    return p + bytes;
+}
+
+static uint64_t
+get_le (const uint8_t **p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) {
+        v |= (uint64_t)(*p)[i] << (8 * i);
+    }
+    *p += bytes;
+    return v;
+}
+
+static void
+emit (struct xrec_bin_writer *writer, const uint8_t *data, size_t length) {
+    writer->sink(writer, data, length);
+    writer->size += length;
+}
+
+// Write one frame, all at once.
+static void
+write_frame (struct xrec_bin_writer *writer, int type, int status, uint16_t address,
+             const uint8_t *data, int length) {
+    uint8_t frame[XREC_BIN_FRAME_SIZE + MAX_PAYLOAD];
+    uint8_t *p = frame;
+    *p++ = (uint8_t)type;
+    *p++ = (uint8_t)status;
+    p = put_le(p, address, 2);
+    p = put_le(p, length, 2);
+    if (length > 0) {
+        memcpy(p, data, length);
+        p += length;
+    }
+    p = put_le(p, xrec_kernels->crc32(0, frame, p - frame), 4);
+    emit(writer, frame, p - frame);
+}
+
+// Make room for one more index entry. Returns nonzero on success.
+static int
+reserve_entry (struct xrec_bin_writer *writer) {
+    if (writer->records < writer->index_capacity) {
+        return 1;
+    }
+    size_t capacity = writer->index_capacity ? writer->index_capacity * 2 : INITIAL_ENTRIES;
+    uint8_t *index = realloc(writer->index, capacity * XREC_BIN_ENTRY_SIZE);
+    if (index == NULL) {
+        return 0;
+    }
+    writer->index = index;
+    writer->index_capacity = capacity;
+    return 1;
+}
+
+void
+xrec_bin_begin_write (struct xrec_bin_writer *writer, xrec_bin_sink_t sink,
+                      void *context, int indexed) {
+    writer->sink = sink;
+    writer->context = context;
+    writer->size = 0;
+    writer->records = 0;
+    writer->indexed = indexed;
+    writer->index = NULL;
+    writer->index_capacity = 0;
+    writer->failed = 0;
+
+    uint8_t header[XREC_BIN_HEADER_SIZE] = { 0 };
+    memcpy(header, XREC_BIN_MAGIC, 4);
+    header[4] = XREC_BIN_VERSION;
+    emit(writer, header, sizeof(header));
+}
+
+int
+xrec_bin_write_record (struct xrec_bin_writer *writer, int record_type, uint16_t address,
+                       const uint8_t *data, int length, int checksum_error) {
+    if (writer->indexed && !writer->failed) {
+        if (reserve_entry(writer)) {
+            uint8_t *p = writer->index + writer->records * XREC_BIN_ENTRY_SIZE;
+            p = put_le(p, writer->size, 8);
+            p = put_le(p, address, 2);
+            put_le(p, length, 2);
+        } else {
+            writer->failed = 1;
+        }
+    }
+    write_frame(writer, record_type, checksum_error ? 1 : 0, address, data, length);
+    writer->records++;
+    return !writer->failed;
+}
+
+int
+xrec_bin_end_write (struct xrec_bin_writer *writer) {
+    write_frame(writer, 0, 0, 0, NULL, 0);
+    if (writer->indexed && !writer->failed) {
+        uint64_t start = writer->size;
+        size_t entries = (size_t)writer->records * XREC_BIN_ENTRY_SIZE;
+        if (entries > 0) {
+            emit(writer, writer->index, entries);
+        }
+        uint8_t footer[XREC_BIN_FOOTER_SIZE];
+        uint8_t *p = put_le(footer, start, 8);
+        p = put_le(p, writer->records, 8);
+        p = put_le(p, xrec_kernels->crc32(0, writer->index, entries), 4);
+        memcpy(p, XREC_BIN_INDEX_MAGIC, 4);
+        emit(writer, footer, sizeof(footer));
+    }
+    free(writer->index);
+    writer->index = NULL;
+    writer->index_capacity = 0;
+    return !writer->failed;
+}
+
+// Find a valid index trailer at the end of the stream.
+static void
+find_index (struct xrec_bin_reader *reader) {
+    reader->index = NULL;
+    reader->index_count = 0;
+    if (reader->length < XREC_BIN_HEADER_SIZE + XREC_BIN_FOOTER_SIZE) {
+        return;
+    }
+    const uint8_t *p = reader->data + reader->length - XREC_BIN_FOOTER_SIZE;
+    if (memcmp(p + XREC_BIN_FOOTER_SIZE - 4, XREC_BIN_INDEX_MAGIC, 4) != 0) {
+        return;
+    }
+    uint64_t start = get_le(&p, 8);
+    uint64_t count = get_le(&p, 8);
+    uint32_t crc = (uint32_t)get_le(&p, 4);
+    uint64_t end = reader->length - XREC_BIN_FOOTER_SIZE;
+    if (start < XREC_BIN_HEADER_SIZE || start > end ||
+        count != (end - start) / XREC_BIN_ENTRY_SIZE ||
+        count * XREC_BIN_ENTRY_SIZE != end - start ||
+        xrec_kernels->crc32(0, reader->data + start, (size_t)(end - start)) != crc) {
+        return;
+    }
+    reader->index = reader->data + start;
+    reader->index_count = count;
+}
+
+// Read the frame at `offset`. Returns 1 if it's a record, 0 if it ends the
+// records, or -1 if it's damaged.
+static int
+read_frame (const struct xrec_bin_reader *reader, uint64_t offset,
+            struct xrec_bin_record *record) {
+    if (offset > reader->length || reader->length - offset < XREC_BIN_FRAME_SIZE) {
+        return -1;
+    }
+    const uint8_t *frame = reader->data + offset;
+    const uint8_t *p = frame;
+    int type = (int)get_le(&p, 1);
+    int status = (int)get_le(&p, 1);
+    uint16_t address = (uint16_t)get_le(&p, 2);
+    int length = (int)get_le(&p, 2);
+    if (length > MAX_PAYLOAD || reader->length - offset < (uint64_t)XREC_BIN_FRAME_SIZE + length) {
+        return -1;
+    }
+    const uint8_t *data = p;
+    p += length;
+    uint32_t crc = xrec_kernels->crc32(0, frame, p - frame);
+    if (get_le(&p, 4) != crc) {
+        return -1;
+    }
+    if (type == 0) {
+        return 0;
+    }
+    record->type = type;
+    record->checksum_error = status & 1;
+    record->address = address;
+    record->length = length;
+    record->data = data;
+    record->offset = offset;
+    return 1;
+}
+
+int
+xrec_bin_open (struct xrec_bin_reader *reader, const uint8_t *data, size_t length) {
+    reader->data = data;
+    reader->length = length;
+    reader->position = XREC_BIN_HEADER_SIZE;
+    if (length < XREC_BIN_HEADER_SIZE || memcmp(data, XREC_BIN_MAGIC, 4) != 0 ||
+        data[4] != XREC_BIN_VERSION) {
+        return 0;
+    }
+    find_index(reader);
+    return 1;
+}
+
+int
+xrec_bin_next (struct xrec_bin_reader *reader, struct xrec_bin_record *record) {
+    int result = read_frame(reader, reader->position, record);
+    if (result > 0) {
+        reader->position += XREC_BIN_FRAME_SIZE + record->length;
+    }
+    return result;
+}
+
+int
+xrec_bin_record_at (const struct xrec_bin_reader *reader, uint64_t n,
+                    struct xrec_bin_record *record) {
+    if (reader->index == NULL || n >= reader->index_count) {
+        return 0;
+    }
+    const uint8_t *p = reader->index + n * XREC_BIN_ENTRY_SIZE;
+    uint64_t offset = get_le(&p, 8);
+    int result = read_frame(reader, offset, record);
+    return result == 0 ? -1 : result;
+}
@@ -0,0 +1,133 @@
+/*
+ * xrec_bin.h
+ *
+ * A compact binary record stream, for passing parsed records to other tools
+ * without formatting them as S-records and parsing them again.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      FORMAT
+ *      ------
+ *
+ * All numbers are little-endian. The stream starts with an 8-byte header:
+ *
+ *      "XRBS", version (1), three zero bytes
+ *
+ * Each record is then framed as:
+ *
+ *      type (1), status (1), address (2), length (2), payload, CRC-32 (4)
+ *
+ * where type is the X-record type (1 for data, 9 for termination), bit 0 of
+ * status is set if the record failed its checksum, length is 0 to 256, and
+ * the CRC covers everything from the type through the payload. A frame of
+ * type 0 with a zero address and length ends the records.
+ *
+ * An optional index trailer may follow, with one 12-byte entry per record:
+ *
+ *      frame offset (8), address (2), length (2)
+ *
+ * and then a 24-byte footer, which ends the stream:
+ *
+ *      offset of the first entry (8), entry count (8), CRC-32 of the
+ *      entries (4), "XRBI"
+ *
+ * Each frame costs 10 bytes over its payload, where an S-record line of 16
+ * data bytes takes 44.
+ *
+ *      USAGE
+ *      -----
+ *
+ * Write a stream through a sink of your own, much like `srec_state`:
+ *
+ *      xrec_bin_begin_write(&writer, my_sink, my_context, 1);
+ *      xrec_bin_write_record(&writer, record_type, address, data, length, checksum_error);
+ *      ...
+ *      xrec_bin_end_write(&writer);
+ *
+ * Read one back from memory in order:
+ *
+ *      struct xrec_bin_record record;
+ *      if (xrec_bin_open(&reader, bytes, size)) {
+ *          while (xrec_bin_next(&reader, &record) > 0) {
+ *              // record.address, record.data, record.length ...
+ *          }
+ *      }
+ *
+ * or, if it has an index, by record number with `xrec_bin_record_at`.
+ */
+
+#ifndef XREC_BIN_H
+#define XREC_BIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define XREC_BIN_VERSION        1
+#define XREC_BIN_HEADER_SIZE    8
+#define XREC_BIN_FRAME_SIZE     10      // Not counting the payload
+#define XREC_BIN_ENTRY_SIZE     12
+#define XREC_BIN_FOOTER_SIZE    24
+
+struct xrec_bin_writer;
+
+// Receives `length` bytes of the stream.
+typedef void (*xrec_bin_sink_t)(struct xrec_bin_writer *writer, const uint8_t *data, size_t length);
+
+struct xrec_bin_writer {
+    xrec_bin_sink_t sink;
+    void *          context;        // For the sink's use
+    uint64_t        size;           // Bytes written so far
+    uint64_t        records;
+    int             indexed;        // Nonzero to write an index trailer
+    uint8_t *       index;          // The entries so far, if indexed
+    size_t          index_capacity; // Entries that fit in `index`
+    int             failed;         // Nonzero if the index ran out of memory
+};
+
+struct xrec_bin_record {
+    int             type;
+    int             checksum_error;
+    uint16_t        address;
+    int             length;
+    const uint8_t * data;
+    uint64_t        offset;         // Of the record's frame in the stream
+};
+
+struct xrec_bin_reader {
+    const uint8_t * data;
+    size_t          length;
+    size_t          position;       // Of the next frame
+    const uint8_t * index;          // NULL if the stream has no usable index
+    uint64_t        index_count;
+};
+
+// Start a stream, writing its header. If `indexed` is nonzero, an index
+// trailer is written by `xrec_bin_end_write`.
+void xrec_bin_begin_write(struct xrec_bin_writer *writer, xrec_bin_sink_t sink,
+                          void *context, int indexed);
+
+// Write one record. Returns zero if there isn't enough memory to index it;
+// the record is written regardless.
+int xrec_bin_write_record(struct xrec_bin_writer *writer, int record_type, uint16_t address,
+                          const uint8_t *data, int length, int checksum_error);
+
+// End the stream and write the index trailer if there is one. Returns zero
+// if the index was incomplete, in which case it is left out.
+int xrec_bin_end_write(struct xrec_bin_writer *writer);
+
+// Start reading a stream of `length` bytes. Returns zero if it doesn't
+// start with a header this version can read. A damaged index is ignored.
+int xrec_bin_open(struct xrec_bin_reader *reader, const uint8_t *data, size_t length);
+
+// Read the next record. Returns 1 if there is one, 0 at the end of the
+// records, or -1 if the frame is truncated or fails its CRC.
+int xrec_bin_next(struct xrec_bin_reader *reader, struct xrec_bin_record *record);
+
+// Read record number `n` through the index. Returns 1 on success, 0 if
+// there is no index or no such record, or -1 if the frame is damaged.
+int xrec_bin_record_at(const struct xrec_bin_reader *reader, uint64_t n,
+                       struct xrec_bin_record *record);
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * xrec_cache.c
+ *
+ * A content-addressed cache of conversion output.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include "xrec_cache.h"
+
+#define FNV_PRIME           0x100000001B3ULL
+#define CACHE_SUFFIX        ".s19"
+#define CACHE_NAME_LENGTH   (16 + 4)
+
+struct cache_entry {
+    time_t              modified;
+    unsigned long long  size;
+    char                name[CACHE_NAME_LENGTH + 1];
+};
+
+uint64_t
+xrec_hash_bytes (uint64_t hash, const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+int
+xrec_cache_fetch (struct xrec_cache *cache, const char *directory,
+                  uint64_t key, FILE *out) {
+    cache->file = NULL;
+    snprintf(cache->directory, sizeof(cache->directory), "%s", directory);
+    snprintf(cache->path, sizeof(cache->path), "%s/%016llx" CACHE_SUFFIX,
+             directory, (unsigned long long)key);
+    snprintf(cache->temp_path, sizeof(cache->temp_path), "%s/%016llx.%ld.tmp",
+             directory, (unsigned long long)key, (long)getpid());
+
+    FILE *file = fopen(cache->path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    // Read the whole entry before writing any of it, so that a failed read
+    // is a clean miss rather than a partial copy ahead of the real output.
+    struct stat info;
+    char *buffer = NULL;
+    size_t length = 0;
+    int failed = fstat(fileno(file), &info) != 0 || !S_ISREG(info.st_mode) ||
+                 (unsigned long long)info.st_size > SIZE_MAX;
+    if (!failed) {
+        length = (size_t)info.st_size;
+        buffer = malloc(length ? length : 1);
+        failed = buffer == NULL || fread(buffer, 1, length, file) != length;
+    }
+    fclose(file);
+    if (!failed) {
+        fwrite(buffer, 1, length, out);
+    }
+    free(buffer);
+    if (failed) {
+        return 0;
+    }
+    // Mark the entry as recently used.
+    utime(cache->path, NULL);
+    return 1;
+}
+
+FILE *
+xrec_cache_store_begin (struct xrec_cache *cache) {
+    cache->file = fopen(cache->temp_path, "wb");
+    return cache->file;
+}
+
+static int
+compare_entries (const void *a, const void *b) {
+    const struct cache_entry *x = a;
+    const struct cache_entry *y = b;
+    return (x->modified > y->modified) - (x->modified < y->modified);
+}
+
+static void
+evict (const char *directory, const char *keep, unsigned long long max_bytes) {
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        return;
+    }
+    struct cache_entry *entries = NULL;
+    size_t count = 0, capacity = 0;
+    unsigned long long total = 0;
+    char path[XREC_CACHE_PATH_MAX + 1 + CACHE_NAME_LENGTH + 1];
+    struct dirent *item;
+    while ((item = readdir(dir)) != NULL) {
+        size_t name_length = strlen(item->d_name);
+        struct stat info;
+        if (name_length != CACHE_NAME_LENGTH ||
+            strcmp(item->d_name + name_length - 4, CACHE_SUFFIX) != 0 ||
+            strcmp(item->d_name, keep) == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", directory, item->d_name);
+        if (stat(path, &info) != 0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            struct cache_entry *grown = realloc(entries, capacity * sizeof(*entries));
+            if (grown == NULL) {
+                break;
+            }
+            entries = grown;
+        }
+        entries[count].modified = info.st_mtime;
+        entries[count].size = (unsigned long long)info.st_size;
+        memcpy(entries[count].name, item->d_name, name_length + 1);
+        total += entries[count].size;
+        count++;
+    }
+    closedir(dir);
+
+    // Remove the least recently used entries first.
+    if (count > 1) {
+        qsort(entries, count, sizeof(*entries), compare_entries);
+    }
+    for (size_t i = 0; i < count && total > max_bytes; i++) {
+        snprintf(path, sizeof(path), "%s/%s", directory, entries[i].name);
+        if (unlink(path) == 0) {
+            total -= entries[i].size;
+        }
+    }
+    free(entries);
+}
+
+int
+xrec_cache_store_end (struct xrec_cache *cache, unsigned long long max_bytes) {
+    if (cache->file == NULL) {
+        return 0;
+    }
+    int stored = !ferror(cache->file);
+    stored = fclose(cache->file) == 0 && stored;
+    cache->file = NULL;
+    if (!stored || rename(cache->temp_path, cache->path) != 0) {
+        remove(cache->temp_path);
+        return 0;
+    }
+    // Never evict the entry just stored, even if it alone is over the limit.
+    struct stat info;
+    unsigned long long stored_size = stat(cache->path, &info) == 0 ? (unsigned long long)info.st_size : 0;
+    const char *name = strrchr(cache->path, '/') + 1;
+    evict(cache->directory, name, max_bytes > stored_size ? max_bytes - stored_size : 0);
+    return 1;
+}
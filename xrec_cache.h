@@ -0,0 +1,72 @@
+/*
+ * xrec_cache.h
+ *
+ * A content-addressed cache of conversion output, keyed by a hash of the
+ * input, so that unchanged inputs don't need to be converted again.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * Hash the input as it is read (and anything else that changes the output,
+ * such as options), then look it up:
+ *
+ *      uint64_t key = xrec_hash_bytes(XREC_HASH_SEED, input, length);
+ *      struct xrec_cache cache;
+ *      if (!xrec_cache_fetch(&cache, "cache_dir", key, stdout)) {
+ *          FILE *entry = xrec_cache_store_begin(&cache);
+ *          ... write the output to stdout, and to `entry` if it isn't NULL ...
+ *          if (entry != NULL && !xrec_cache_store_end(&cache, XREC_CACHE_DEFAULT_SIZE)) {
+ *              ... the output is complete; only the entry was lost ...
+ *          }
+ *      }
+ *
+ * Entries are files named by key in the cache directory. Output is written
+ * to a temporary file and renamed into place, so a concurrent job never sees
+ * a partial entry. Each hit refreshes the entry's modification time, and
+ * storing an entry evicts the least recently used ones until the directory
+ * is within its size limit.
+ *
+ * The hash is 64-bit FNV-1a, which is fast but not cryptographic; it guards
+ * against accidental, not deliberate, collisions.
+ */
+
+#ifndef XREC_CACHE_H
+#define XREC_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define XREC_HASH_SEED          0xCBF29CE484222325ULL
+#define XREC_CACHE_DEFAULT_SIZE (256ULL * 1024 * 1024)
+#define XREC_CACHE_PATH_MAX     1024
+
+struct xrec_cache {
+    char    directory[XREC_CACHE_PATH_MAX];
+    char    path[XREC_CACHE_PATH_MAX];
+    char    temp_path[XREC_CACHE_PATH_MAX];
+    FILE *  file;
+};
+
+// Continue a hash of a byte stream. Start with XREC_HASH_SEED.
+uint64_t xrec_hash_bytes(uint64_t hash, const uint8_t *data, size_t length);
+
+// Look up `key` in the cache in `directory`. On a hit, copy the entry to
+// `out` and return nonzero. An entry that can't be read in full is a miss,
+// and nothing is written to `out`.
+int xrec_cache_fetch(struct xrec_cache *cache, const char *directory,
+                     uint64_t key, FILE *out);
+
+// Begin storing the entry for the key last looked up. Returns the file to
+// write it to, or NULL if the cache directory isn't writable.
+FILE *xrec_cache_store_begin(struct xrec_cache *cache);
+
+// Finish storing the entry, then evict old entries until the cache holds no
+// more than `max_bytes`. Returns nonzero if the entry was stored.
+int xrec_cache_store_end(struct xrec_cache *cache, unsigned long long max_bytes);
+
+#endif
@@ -0,0 +1,478 @@
+/*
+ * xrec_catalog.c
+ *
+ * A catalog of many tapes.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xrec.h"
+#include "xrec_cache.h"
+#include "xrec_catalog.h"
+#include "xrec_fingerprint.h"
+#include "xrec_kernels.h"
+
+#define XREC_CATALOG_MAGIC  "XRCT"
+#define SCAN_CHUNK_SIZE     0x40000000
+
+// What `xrec_catalog_scan` needs in its callback.
+struct scan_state {
+    struct xrec_catalog_tape *  tape;
+    struct xrec_fingerprint *   fingerprint;
+};
+
+// An image hash and the tape it belongs to, for sorting.
+struct image_key {
+    uint64_t    xxh64;
+    long        tape;
+};
+
+static void
+put_le16 (uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void
+put_le32 (uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static void
+put_le64 (uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+static uint16_t
+get_le16 (const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t
+get_le32 (const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t
+get_le64 (const uint8_t *p) {
+    return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static enum xrec_action
+count_record (struct xrec_state *xrec,
+              int record_type,
+              uint16_t address,
+              uint8_t *data,
+              int length,
+              int checksum_error) {
+    struct scan_state *scan = xrec->context;
+    if (record_type == XREC_DATA_16BIT) {
+        scan->tape->data_records++;
+        if (checksum_error) {
+            scan->tape->failed_records++;
+        }
+        xrec_fingerprint_add(scan->fingerprint, address, data, length);
+    } else if (record_type == XREC_TERMINATION_16BIT) {
+        scan->tape->terminations++;
+    }
+    return XREC_CONTINUE;
+}
+
+int
+xrec_catalog_scan (struct xrec_catalog_tape *tape, const uint8_t *data, long length) {
+    memset(tape, 0, sizeof(*tape));
+    tape->file_size = (uint64_t)length;
+    tape->file_hash = xrec_hash_bytes(XREC_HASH_SEED, data, (size_t)length);
+
+    struct xrec_fingerprint *fingerprint = malloc(sizeof(*fingerprint));
+    if (fingerprint == NULL) {
+        return 0;
+    }
+    xrec_fingerprint_init(fingerprint);
+    struct scan_state scan = { tape, fingerprint };
+    struct xrec_state xrec;
+    xrec_begin_read(&xrec);
+#ifdef XREC_COMPACT_STATE
+    uint8_t record[XREC_RECORD_SIZE];
+    xrec.data = record;
+#endif
+    xrec.context = &scan;
+    xrec.callback = count_record;
+    for (long offset = 0; offset < length; offset += SCAN_CHUNK_SIZE) {
+        long count = length - offset;
+        if (count > SCAN_CHUNK_SIZE) {
+            count = SCAN_CHUNK_SIZE;
+        }
+        xrec_read_bytes(&xrec, (const char *)data + offset, (int)count);
+    }
+    xrec_fingerprint_finish(fingerprint, &tape->image_crc32, &tape->image_xxh64);
+
+    // The written ranges, counted and then collected.
+    const struct xrec_coverage *coverage = &fingerprint->coverage;
+    uint16_t low, high;
+    long next = 0;
+    while ((next = xrec_coverage_next_range(coverage, XREC_COVERAGE_WRITTEN, next, &low, &high)) >= 0) {
+        tape->range_count++;
+    }
+    if (tape->range_count > 0) {
+        tape->ranges = malloc(tape->range_count * sizeof(*tape->ranges));
+        if (tape->ranges == NULL) {
+            free(fingerprint);
+            return 0;
+        }
+        long i = 0;
+        next = 0;
+        while ((next = xrec_coverage_next_range(coverage, XREC_COVERAGE_WRITTEN, next, &low, &high)) >= 0) {
+            tape->ranges[i].low = low;
+            tape->ranges[i].high = high;
+            i++;
+        }
+    }
+    free(fingerprint);
+
+    tape->program_count = xrec_split_programs(data, length, XREC_SPLIT_DEFAULT_GAP, &tape->programs);
+    if (tape->program_count < 0) {
+        tape->program_count = 0;
+        xrec_catalog_tape_free(tape);
+        return 0;
+    }
+    return 1;
+}
+
+void
+xrec_catalog_tape_free (struct xrec_catalog_tape *tape) {
+    free(tape->ranges);
+    free(tape->programs);
+    tape->ranges = NULL;
+    tape->programs = NULL;
+}
+
+static int
+compare_images (const void *a, const void *b) {
+    const struct image_key *x = a;
+    const struct image_key *y = b;
+    if (x->xxh64 != y->xxh64) {
+        return x->xxh64 < y->xxh64 ? -1 : 1;
+    }
+    return x->tape < y->tape ? -1 : x->tape > y->tape;
+}
+
+// Mark the pages of memory a tape writes to.
+static void
+tape_pages (const struct xrec_catalog_tape *tape, uint8_t pages[XREC_CATALOG_PAGES]) {
+    memset(pages, 0, XREC_CATALOG_PAGES);
+    for (long r = 0; r < tape->range_count; r++) {
+        for (int page = tape->ranges[r].low >> 8; page <= tape->ranges[r].high >> 8; page++) {
+            pages[page] = 1;
+        }
+    }
+}
+
+size_t
+xrec_catalog_serialize (const struct xrec_catalog_tape *tapes, long count, uint8_t *out) {
+    long ranges = 0, programs = 0, page_entries = 0;
+    size_t paths = 0;
+    uint32_t page_counts[XREC_CATALOG_PAGES] = { 0 };
+    uint8_t pages[XREC_CATALOG_PAGES];
+    for (long t = 0; t < count; t++) {
+        ranges += tapes[t].range_count;
+        programs += tapes[t].program_count;
+        paths += tapes[t].path_length;
+        tape_pages(&tapes[t], pages);
+        for (int page = 0; page < XREC_CATALOG_PAGES; page++) {
+            page_counts[page] += pages[page];
+        }
+    }
+    for (int p = 0; p < XREC_CATALOG_PAGES; p++) {
+        page_entries += page_counts[p];
+    }
+    size_t size = XREC_CATALOG_HEADER_SIZE +
+                  (size_t)count * XREC_CATALOG_TAPE_SIZE +
+                  (size_t)ranges * XREC_CATALOG_RANGE_SIZE +
+                  (size_t)programs * XREC_CATALOG_PROGRAM_SIZE +
+                  (size_t)count * XREC_CATALOG_IMAGE_SIZE +
+                  (XREC_CATALOG_PAGES + 1) * 4 + (size_t)page_entries * 4 +
+                  paths;
+    if (out == NULL) {
+        return size;
+    }
+
+    struct image_key *images = malloc((count ? count : 1) * sizeof(*images));
+    if (images == NULL) {
+        return 0;
+    }
+    for (long t = 0; t < count; t++) {
+        images[t].xxh64 = tapes[t].image_xxh64;
+        images[t].tape = t;
+    }
+    qsort(images, count, sizeof(*images), compare_images);
+
+    memcpy(out, XREC_CATALOG_MAGIC, 4);
+    put_le32(out + 4, XREC_CATALOG_VERSION);
+    put_le32(out + 8, (uint32_t)count);
+    put_le32(out + 12, (uint32_t)ranges);
+    put_le32(out + 16, (uint32_t)programs);
+    put_le32(out + 20, (uint32_t)paths);
+    put_le32(out + 28, 0);
+
+    uint8_t *p = out + XREC_CATALOG_HEADER_SIZE;
+    long first_range = 0, first_program = 0;
+    size_t path_offset = 0;
+    for (long t = 0; t < count; t++, p += XREC_CATALOG_TAPE_SIZE) {
+        const struct xrec_catalog_tape *tape = &tapes[t];
+        put_le64(p, tape->file_size);
+        put_le64(p + 8, tape->file_hash);
+        put_le64(p + 16, tape->image_xxh64);
+        put_le32(p + 24, tape->image_crc32);
+        put_le32(p + 28, (uint32_t)tape->data_records);
+        put_le32(p + 32, (uint32_t)tape->failed_records);
+        put_le32(p + 36, (uint32_t)tape->terminations);
+        put_le32(p + 40, (uint32_t)first_range);
+        put_le32(p + 44, (uint32_t)tape->range_count);
+        put_le32(p + 48, (uint32_t)first_program);
+        put_le32(p + 52, (uint32_t)tape->program_count);
+        put_le32(p + 56, (uint32_t)path_offset);
+        put_le32(p + 60, (uint32_t)tape->path_length);
+        first_range += tape->range_count;
+        first_program += tape->program_count;
+        path_offset += tape->path_length;
+    }
+    for (long t = 0; t < count; t++) {
+        for (long r = 0; r < tapes[t].range_count; r++, p += XREC_CATALOG_RANGE_SIZE) {
+            put_le16(p, tapes[t].ranges[r].low);
+            put_le16(p + 2, tapes[t].ranges[r].high);
+        }
+    }
+    for (long t = 0; t < count; t++) {
+        for (long i = 0; i < tapes[t].program_count; i++, p += XREC_CATALOG_PROGRAM_SIZE) {
+            const struct xrec_program *program = &tapes[t].programs[i];
+            put_le64(p, (uint64_t)program->start);
+            put_le64(p + 8, (uint64_t)program->end);
+            put_le32(p + 16, (uint32_t)program->records);
+            put_le32(p + 20, (uint32_t)program->terminated);
+        }
+    }
+    for (long i = 0; i < count; i++, p += XREC_CATALOG_IMAGE_SIZE) {
+        put_le64(p, images[i].xxh64);
+        put_le32(p + 8, (uint32_t)images[i].tape);
+    }
+    free(images);
+
+    // Page offsets, then each page's tapes in order.
+    uint32_t cursor[XREC_CATALOG_PAGES];
+    uint32_t offset = 0;
+    for (int page = 0; page < XREC_CATALOG_PAGES; page++) {
+        put_le32(p + 4 * page, offset);
+        cursor[page] = offset;
+        offset += page_counts[page];
+    }
+    put_le32(p + 4 * XREC_CATALOG_PAGES, offset);
+    p += (XREC_CATALOG_PAGES + 1) * 4;
+    for (long t = 0; t < count; t++) {
+        tape_pages(&tapes[t], pages);
+        for (int page = 0; page < XREC_CATALOG_PAGES; page++) {
+            if (pages[page]) {
+                put_le32(p + 4 * cursor[page]++, (uint32_t)t);
+            }
+        }
+    }
+    p += (size_t)page_entries * 4;
+
+    for (long t = 0; t < count; t++) {
+        memcpy(p, tapes[t].path, tapes[t].path_length);
+        p += tapes[t].path_length;
+    }
+    put_le32(out + 24, xrec_kernels->crc32(0, out + XREC_CATALOG_HEADER_SIZE,
+                                           size - XREC_CATALOG_HEADER_SIZE));
+    return size;
+}
+
+int
+xrec_catalog_open (struct xrec_catalog *catalog, const uint8_t *data, size_t length) {
+    memset(catalog, 0, sizeof(*catalog));
+    if (length < XREC_CATALOG_HEADER_SIZE || memcmp(data, XREC_CATALOG_MAGIC, 4) != 0 ||
+        get_le32(data + 4) != XREC_CATALOG_VERSION ||
+        get_le32(data + 24) != xrec_kernels->crc32(0, data + XREC_CATALOG_HEADER_SIZE,
+                                                   length - XREC_CATALOG_HEADER_SIZE)) {
+        return 0;
+    }
+    uint64_t tapes = get_le32(data + 8);
+    uint64_t ranges = get_le32(data + 12);
+    uint64_t programs = get_le32(data + 16);
+    uint64_t paths = get_le32(data + 20);
+    uint64_t fixed = XREC_CATALOG_HEADER_SIZE +
+                     tapes * (XREC_CATALOG_TAPE_SIZE + XREC_CATALOG_IMAGE_SIZE) +
+                     ranges * XREC_CATALOG_RANGE_SIZE +
+                     programs * XREC_CATALOG_PROGRAM_SIZE +
+                     (XREC_CATALOG_PAGES + 1) * 4;
+    if (fixed + paths > length) {
+        return 0;
+    }
+    catalog->data = data;
+    catalog->length = length;
+    catalog->tape_count = (long)tapes;
+    catalog->range_count = (long)ranges;
+    catalog->program_count = (long)programs;
+    catalog->tapes = data + XREC_CATALOG_HEADER_SIZE;
+    catalog->ranges = catalog->tapes + tapes * XREC_CATALOG_TAPE_SIZE;
+    catalog->programs = catalog->ranges + ranges * XREC_CATALOG_RANGE_SIZE;
+    catalog->images = catalog->programs + programs * XREC_CATALOG_PROGRAM_SIZE;
+    catalog->pages = catalog->images + tapes * XREC_CATALOG_IMAGE_SIZE;
+    catalog->page_tapes = catalog->pages + (XREC_CATALOG_PAGES + 1) * 4;
+    uint64_t page_entries = get_le32(catalog->pages + 4 * XREC_CATALOG_PAGES);
+    if (fixed + page_entries * 4 + paths != length) {
+        return 0;
+    }
+    catalog->paths = (const char *)catalog->page_tapes + page_entries * 4;
+    catalog->paths_length = (size_t)paths;
+
+    // Check everything the lookups rely on, so they needn't.
+    for (int page = 0; page < XREC_CATALOG_PAGES; page++) {
+        if (get_le32(catalog->pages + 4 * page) > get_le32(catalog->pages + 4 * (page + 1))) {
+            return 0;
+        }
+    }
+    for (uint64_t i = 0; i < page_entries; i++) {
+        if (get_le32(catalog->page_tapes + 4 * i) >= tapes) {
+            return 0;
+        }
+    }
+    for (uint64_t i = 0; i < tapes; i++) {
+        const uint8_t *image = catalog->images + i * XREC_CATALOG_IMAGE_SIZE;
+        if (get_le32(image + 8) >= tapes ||
+            (i > 0 && get_le64(image - XREC_CATALOG_IMAGE_SIZE) > get_le64(image))) {
+            return 0;
+        }
+        const uint8_t *tape = catalog->tapes + i * XREC_CATALOG_TAPE_SIZE;
+        if ((uint64_t)get_le32(tape + 40) + get_le32(tape + 44) > ranges ||
+            (uint64_t)get_le32(tape + 48) + get_le32(tape + 52) > programs ||
+            (uint64_t)get_le32(tape + 56) + get_le32(tape + 60) > paths) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void
+xrec_catalog_get_tape (const struct xrec_catalog *catalog, long n,
+                       struct xrec_catalog_tape *tape) {
+    const uint8_t *p = catalog->tapes + (size_t)n * XREC_CATALOG_TAPE_SIZE;
+    memset(tape, 0, sizeof(*tape));
+    tape->file_size = get_le64(p);
+    tape->file_hash = get_le64(p + 8);
+    tape->image_xxh64 = get_le64(p + 16);
+    tape->image_crc32 = get_le32(p + 24);
+    tape->data_records = get_le32(p + 28);
+    tape->failed_records = get_le32(p + 32);
+    tape->terminations = get_le32(p + 36);
+    tape->first_range = get_le32(p + 40);
+    tape->range_count = get_le32(p + 44);
+    tape->first_program = get_le32(p + 48);
+    tape->program_count = get_le32(p + 52);
+    tape->path = catalog->paths + get_le32(p + 56);
+    tape->path_length = get_le32(p + 60);
+}
+
+struct xrec_catalog_range
+xrec_catalog_get_range (const struct xrec_catalog *catalog, long n) {
+    const uint8_t *p = catalog->ranges + (size_t)n * XREC_CATALOG_RANGE_SIZE;
+    struct xrec_catalog_range range = { get_le16(p), get_le16(p + 2) };
+    return range;
+}
+
+struct xrec_program
+xrec_catalog_get_program (const struct xrec_catalog *catalog, long n) {
+    const uint8_t *p = catalog->programs + (size_t)n * XREC_CATALOG_PROGRAM_SIZE;
+    struct xrec_program program;
+    program.start = (long)get_le64(p);
+    program.end = (long)get_le64(p + 8);
+    program.records = (long)get_le32(p + 16);
+    program.terminated = (int)get_le32(p + 20);
+    return program;
+}
+
+long
+xrec_catalog_find_image (const struct xrec_catalog *catalog, uint64_t xxh64,
+                         long *tapes, long max) {
+    // The first entry with this hash or a greater one.
+    long low = 0, high = catalog->tape_count;
+    while (low < high) {
+        long middle = low + (high - low) / 2;
+        if (get_le64(catalog->images + (size_t)middle * XREC_CATALOG_IMAGE_SIZE) < xxh64) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    long found = 0;
+    for (long i = low; i < catalog->tape_count; i++) {
+        const uint8_t *image = catalog->images + (size_t)i * XREC_CATALOG_IMAGE_SIZE;
+        if (get_le64(image) != xxh64) {
+            break;
+        }
+        if (found < max) {
+            tapes[found] = get_le32(image + 8);
+        }
+        found++;
+    }
+    return found;
+}
+
+// Whether any range of tape `n` overlaps `low` through `high`.
+static int
+tape_writes (const struct xrec_catalog *catalog, long n, uint16_t low, uint16_t high) {
+    const uint8_t *tape = catalog->tapes + (size_t)n * XREC_CATALOG_TAPE_SIZE;
+    long first = get_le32(tape + 40);
+    long count = get_le32(tape + 44);
+    for (long r = first; r < first + count; r++) {
+        struct xrec_catalog_range range = xrec_catalog_get_range(catalog, r);
+        if (range.low <= high && range.high >= low) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+long
+xrec_catalog_find_addresses (const struct xrec_catalog *catalog,
+                             uint16_t low, uint16_t high, long *tapes, long max) {
+    // Two bits per tape: checked, and found to match.
+    size_t words = ((size_t)catalog->tape_count + 31) / 32;
+    uint64_t *marks = calloc(words ? words : 1, sizeof(*marks));
+    if (marks == NULL) {
+        return -1;
+    }
+    for (int page = low >> 8; page <= high >> 8; page++) {
+        uint32_t end = get_le32(catalog->pages + 4 * (page + 1));
+        for (uint32_t i = get_le32(catalog->pages + 4 * page); i < end; i++) {
+            long n = get_le32(catalog->page_tapes + 4 * (size_t)i);
+            uint64_t checked = 1ULL << (2 * (n & 31));
+            uint64_t *mark = &marks[n / 32];
+            if (!(*mark & checked)) {
+                *mark |= checked;
+                if (tape_writes(catalog, n, low, high)) {
+                    *mark |= checked << 1;
+                }
+            }
+        }
+    }
+    long found = 0;
+    for (long n = 0; n < catalog->tape_count; n++) {
+        if (marks[n / 32] & (2ULL << (2 * (n & 31)))) {
+            if (found < max) {
+                tapes[found] = n;
+            }
+            found++;
+        }
+    }
+    free(marks);
+    return found;
+}
@@ -0,0 +1,152 @@
+/*
+ * xrec_catalog.h
+ *
+ * A catalog of many tapes: what each one loads, where, and in what shape,
+ * in a compact file that answers lookups across thousands of tapes without
+ * parsing any of them again.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * Describe each tape from its contents in memory (this is independent per
+ * tape, so several can be scanned at once on different threads):
+ *
+ *      struct xrec_catalog_tape tape;
+ *      xrec_catalog_scan(&tape, data, length);
+ *      tape.path = "tapes/basic.bin";
+ *
+ * and then write the lot with `xrec_catalog_serialize`. To look things up,
+ * open the serialized catalog where it lies in memory:
+ *
+ *      struct xrec_catalog catalog;
+ *      if (xrec_catalog_open(&catalog, bytes, size)) {
+ *          long found = xrec_catalog_find_image(&catalog, xxh64, tapes, max_tapes);
+ *          long loading = xrec_catalog_find_addresses(&catalog, 0x0000, 0x1FFF,
+ *                                                     tapes, max_tapes);
+ *      }
+ *
+ * and fetch what's known about each tape with `xrec_catalog_get_tape`.
+ *
+ *      FORMAT
+ *      ------
+ *
+ * All numbers are little-endian. A 32-byte header ("XRCT", version, and the
+ * tape, range and program counts, the size of the path strings, and a
+ * CRC-32 of everything after the header) is followed by:
+ *
+ *      tapes       64 bytes each: file size, file hash, image XXH64, image
+ *                  CRC-32, data, failed and termination record counts, first
+ *                  range and count, first program and count, path offset and
+ *                  length
+ *      ranges      4 bytes each: low and high address written
+ *      programs    24 bytes each: start and end offset, records, terminated
+ *      images      12 bytes per tape: image XXH64 and tape, sorted by hash
+ *      pages       257 offsets into the list that follows, and then for
+ *                  each 256-byte page of memory the tapes that write to it
+ *      paths       the tapes' paths, end to end
+ *
+ * An image lookup is a binary search of the sorted hashes. An address
+ * lookup only checks the tapes listed for the pages it covers.
+ */
+
+#ifndef XREC_CATALOG_H
+#define XREC_CATALOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "xrec_split.h"
+
+#define XREC_CATALOG_VERSION        1
+#define XREC_CATALOG_HEADER_SIZE    32
+#define XREC_CATALOG_TAPE_SIZE      64
+#define XREC_CATALOG_RANGE_SIZE     4
+#define XREC_CATALOG_PROGRAM_SIZE   24
+#define XREC_CATALOG_IMAGE_SIZE     12
+#define XREC_CATALOG_PAGES          256
+
+struct xrec_catalog_range {
+    uint16_t    low;
+    uint16_t    high;
+};
+
+// What's known about one tape. When a tape is scanned, `ranges` and
+// `programs` are allocated and must be released with
+// `xrec_catalog_tape_free`. When it comes from a catalog, they are NULL
+// and `first_range` and `first_program` number its entries there instead,
+// and `path` points into the catalog, without a NUL.
+struct xrec_catalog_tape {
+    const char *                path;
+    size_t                      path_length;
+    uint64_t                    file_size;
+    uint64_t                    file_hash;      // xrec_hash_bytes of the whole file
+    uint64_t                    image_xxh64;    // See xrec_fingerprint.h
+    uint32_t                    image_crc32;
+    long                        data_records;
+    long                        failed_records; // Data records that failed their checksum
+    long                        terminations;
+    long                        range_count;    // Written address ranges
+    long                        program_count;
+    struct xrec_catalog_range * ranges;
+    struct xrec_program *       programs;
+    long                        first_range;
+    long                        first_program;
+};
+
+// A serialized catalog, opened where it lies in memory.
+struct xrec_catalog {
+    const uint8_t * data;
+    size_t          length;
+    long            tape_count;
+    long            range_count;
+    long            program_count;
+    const uint8_t * tapes;
+    const uint8_t * ranges;
+    const uint8_t * programs;
+    const uint8_t * images;
+    const uint8_t * pages;
+    const uint8_t * page_tapes;
+    const char *    paths;
+    size_t          paths_length;
+};
+
+// Describe the tape whose contents are `data`. The path is left NULL for
+// the caller to set. Returns zero if there isn't enough memory.
+int xrec_catalog_scan(struct xrec_catalog_tape *tape, const uint8_t *data, long length);
+
+// Release what `xrec_catalog_scan` allocated.
+void xrec_catalog_tape_free(struct xrec_catalog_tape *tape);
+
+// Write a catalog of `count` scanned tapes to `out`, or if `out` is NULL
+// just compute its size. Returns the number of bytes in the catalog, or 0
+// if there isn't enough memory to sort it.
+size_t xrec_catalog_serialize(const struct xrec_catalog_tape *tapes, long count, uint8_t *out);
+
+// Open a serialized catalog of `length` bytes, which must stay in place
+// while the catalog is used. Returns zero if it is malformed.
+int xrec_catalog_open(struct xrec_catalog *catalog, const uint8_t *data, size_t length);
+
+// Fetch tape number `n`.
+void xrec_catalog_get_tape(const struct xrec_catalog *catalog, long n,
+                           struct xrec_catalog_tape *tape);
+
+// Fetch range number `n` of the catalog.
+struct xrec_catalog_range xrec_catalog_get_range(const struct xrec_catalog *catalog, long n);
+
+// Fetch program number `n` of the catalog.
+struct xrec_program xrec_catalog_get_program(const struct xrec_catalog *catalog, long n);
+
+// Find the tapes whose image has the XXH64 hash `xxh64`. The first `max`
+// tape numbers are stored in `tapes`, in order; returns how many there are.
+long xrec_catalog_find_image(const struct xrec_catalog *catalog, uint64_t xxh64,
+                             long *tapes, long max);
+
+// Find the tapes that write to any address from `low` through `high`, as
+// with `xrec_catalog_find_image`. Returns -1 if there isn't enough memory.
+long xrec_catalog_find_addresses(const struct xrec_catalog *catalog,
+                                 uint16_t low, uint16_t high, long *tapes, long max);
+
+#endif
@@ -0,0 +1,384 @@
+//
+//  xrec_catalog_tool.c
+//
+//  Builds and searches a catalog of many X-record tapes. Building scans
+//  every file under the directories given, one thread per CPU, and writes
+//  what each tape loads (address ranges, image hashes, record counts,
+//  checksum failures and program boundaries) to a compact catalog file.
+//  Searching opens that file and answers without touching the tapes.
+//
+//      cc -O2 -pthread xrec_catalog_tool.c xrec_catalog.c xrec.c xrec_cache.c
+//          xrec_coverage.c xrec_fingerprint.c xrec_kernels.c xrec_split.c -o xrec_catalog
+//
+// Copyright (c) 2022 Ben Zotto
+//
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "xrec_catalog.h"
+#include "xrec_kernels.h"
+
+#define MAX_INGEST_THREADS      64
+#define MAX_RANGES_SHOWN        8
+#define CATALOG_PATH_MAX        1024
+
+// A growing list of file paths.
+struct path_list {
+    char ** paths;
+    long count;
+    long capacity;
+};
+
+// Work shared by the threads that scan the tapes.
+struct ingest_job {
+    char ** paths;
+    long count;
+    struct xrec_catalog_tape * tapes;
+    int * scanned;        // Nonzero for each tape that was read and scanned.
+    pthread_mutex_t lock;
+    long next;            // The next tape to scan, under the lock.
+};
+
+// The parser calls back through each state's own callback, so this is never
+// used, but the library expects it to exist.
+enum xrec_action xrec_data_read(struct xrec_state * xrec,
+                                int record_type,
+                                uint16_t address,
+                                uint8_t * data,
+                                int length,
+                                int checksum_error)
+{
+    (void)xrec;
+    (void)record_type;
+    (void)address;
+    (void)data;
+    (void)length;
+    (void)checksum_error;
+    return XREC_CONTINUE;
+}
+
+void print_usage(const char * program)
+{
+    printf("usage: %s -b catalog_file directory_or_file...\n", program);
+    printf("       %s -l catalog_file\n", program);
+    printf("       %s -x image_hash catalog_file\n", program);
+    printf("       %s -q low-high catalog_file\n", program);
+    printf("  -b    scan every file under the directories given and write a catalog of them\n");
+    printf("  -l    list every tape in the catalog\n");
+    printf("  -x    list the tapes whose image has this XXH64 hash (as shown by xrec2srec -x)\n");
+    printf("  -q    list the tapes that load anything at hex addresses low-high\n");
+}
+
+// Read an entire file into a newly allocated buffer. Returns NULL on failure.
+uint8_t * read_file(const char * path, long * size)
+{
+    FILE * file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    uint8_t * data = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0 &&
+        fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc(length ? length : 1);
+        if (data != NULL && fread(data, 1, length, file) != (size_t)length) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(file);
+    *size = length;
+    return data;
+}
+
+int add_path(struct path_list * list, const char * path)
+{
+    if (list->count == list->capacity) {
+        long capacity = list->capacity ? list->capacity * 2 : 256;
+        char ** paths = realloc(list->paths, capacity * sizeof(*paths));
+        if (paths == NULL) {
+            return 0;
+        }
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    list->paths[list->count] = strdup(path);
+    return list->paths[list->count++] != NULL;
+}
+
+// Add every regular file at or under `path`. Returns zero if out of memory.
+int collect_paths(struct path_list * list, const char * path)
+{
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return 1;
+    }
+    if (S_ISREG(info.st_mode)) {
+        return add_path(list, path);
+    }
+    if (!S_ISDIR(info.st_mode)) {
+        return 1;
+    }
+    DIR * directory = opendir(path);
+    if (directory == NULL) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return 1;
+    }
+    struct dirent * entry;
+    int success = 1;
+    while (success && (entry = readdir(directory)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char child[CATALOG_PATH_MAX];
+        if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) >= (int)sizeof(child)) {
+            fprintf(stderr, "Path too long: %s/%s\n", path, entry->d_name);
+            continue;
+        }
+        success = collect_paths(list, child);
+    }
+    closedir(directory);
+    return success;
+}
+
+int compare_paths(const void * a, const void * b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// Ingest thread: scan tapes until there are none left.
+void * scan_tapes(void * context)
+{
+    struct ingest_job * job = context;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        long n = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (n >= job->count) {
+            break;
+        }
+        long size;
+        uint8_t * data = read_file(job->paths[n], &size);
+        if (data == NULL) {
+            continue;
+        }
+        struct xrec_catalog_tape * tape = &job->tapes[n];
+        if (xrec_catalog_scan(tape, data, size)) {
+            tape->path = job->paths[n];
+            tape->path_length = strlen(tape->path);
+            job->scanned[n] = 1;
+        }
+        free(data);
+    }
+    return NULL;
+}
+
+// Scan the tapes under `inputs` and write their catalog to `catalog_path`.
+// Returns nonzero on success.
+int build_catalog(const char * catalog_path, const char ** inputs, int input_count)
+{
+    struct path_list list = { NULL, 0, 0 };
+    for (int i = 0; i < input_count; i++) {
+        if (!collect_paths(&list, inputs[i])) {
+            printf("Not enough memory to list the tapes\n");
+            return 0;
+        }
+    }
+    qsort(list.paths, list.count, sizeof(*list.paths), compare_paths);
+
+    struct ingest_job job;
+    job.paths = list.paths;
+    job.count = list.count;
+    job.tapes = calloc(list.count ? list.count : 1, sizeof(*job.tapes));
+    job.scanned = calloc(list.count ? list.count : 1, sizeof(*job.scanned));
+    job.next = 0;
+    if (job.tapes == NULL || job.scanned == NULL) {
+        printf("Not enough memory to scan the tapes\n");
+        return 0;
+    }
+    pthread_mutex_init(&job.lock, NULL);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = cpus < 1 ? 1 : cpus > MAX_INGEST_THREADS ? MAX_INGEST_THREADS : (int)cpus;
+    if (thread_count > list.count) {
+        thread_count = list.count > 0 ? (int)list.count : 1;
+    }
+    pthread_t threads[MAX_INGEST_THREADS];
+    int started = 0;
+    while (started < thread_count &&
+           pthread_create(&threads[started], NULL, scan_tapes, &job) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        scan_tapes(&job);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&job.lock);
+
+    // Keep the tapes that scanned, in path order.
+    long count = 0;
+    for (long n = 0; n < list.count; n++) {
+        if (job.scanned[n]) {
+            job.tapes[count++] = job.tapes[n];
+        } else {
+            fprintf(stderr, "Unable to scan %s\n", list.paths[n]);
+        }
+    }
+
+    int success = 0;
+    size_t size = xrec_catalog_serialize(job.tapes, count, NULL);
+    uint8_t * catalog = malloc(size);
+    char temporary_path[CATALOG_PATH_MAX];
+    if (catalog == NULL || xrec_catalog_serialize(job.tapes, count, catalog) != size) {
+        printf("Not enough memory for the catalog\n");
+    } else if (snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", catalog_path) >=
+               (int)sizeof(temporary_path)) {
+        printf("Path too long: %s\n", catalog_path);
+    } else {
+        // Write it aside and rename it into place, so that an interrupted
+        // build leaves the previous catalog intact.
+        FILE * file = fopen(temporary_path, "wb");
+        success = file != NULL && fwrite(catalog, 1, size, file) == size;
+        if (file != NULL && fclose(file) != 0) {
+            success = 0;
+        }
+        if (success && rename(temporary_path, catalog_path) != 0) {
+            success = 0;
+        }
+        if (!success) {
+            remove(temporary_path);
+            printf("Unable to write %s\n", catalog_path);
+        } else {
+            printf("Catalogued %ld tape(s) in %s (%zu bytes).\n", count, catalog_path, size);
+        }
+    }
+    free(catalog);
+    for (long n = 0; n < count; n++) {
+        xrec_catalog_tape_free(&job.tapes[n]);
+    }
+    for (long n = 0; n < list.count; n++) {
+        free(list.paths[n]);
+    }
+    free(list.paths);
+    free(job.tapes);
+    free(job.scanned);
+    return success;
+}
+
+// Show one tape in full.
+void print_tape(const struct xrec_catalog * catalog, long n)
+{
+    struct xrec_catalog_tape tape;
+    xrec_catalog_get_tape(catalog, n, &tape);
+    printf("%.*s\n", (int)tape.path_length, tape.path);
+    printf("  %llu bytes, %ld data record(s), %ld failed checksum(s), %ld termination(s)\n",
+           (unsigned long long)tape.file_size, tape.data_records, tape.failed_records,
+           tape.terminations);
+    printf("  image CRC-32 %08lX, XXH64 %016llX\n",
+           (unsigned long)tape.image_crc32, (unsigned long long)tape.image_xxh64);
+    printf("  loads");
+    for (long r = 0; r < tape.range_count && r < MAX_RANGES_SHOWN; r++) {
+        struct xrec_catalog_range range = xrec_catalog_get_range(catalog, tape.first_range + r);
+        printf(" $%04X-$%04X", range.low, range.high);
+    }
+    if (tape.range_count > MAX_RANGES_SHOWN) {
+        printf(" and %ld more", tape.range_count - MAX_RANGES_SHOWN);
+    } else if (tape.range_count == 0) {
+        printf(" nothing");
+    }
+    printf("\n");
+    for (long i = 0; i < tape.program_count; i++) {
+        struct xrec_program program = xrec_catalog_get_program(catalog, tape.first_program + i);
+        printf("  program %ld at offsets %ld-%ld, %ld record(s)%s\n", i + 1,
+               program.start, program.end, program.records,
+               program.terminated ? "" : ", no termination record");
+    }
+}
+
+// Print the paths of the tapes found by a lookup.
+void print_found(const struct xrec_catalog * catalog, const long * tapes, long found)
+{
+    for (long i = 0; i < found; i++) {
+        struct xrec_catalog_tape tape;
+        xrec_catalog_get_tape(catalog, tapes[i], &tape);
+        printf("%.*s\n", (int)tape.path_length, tape.path);
+    }
+}
+
+int main(int argc, const char * argv[])
+{
+    xrec_kernels_init(getenv("XREC_KERNEL"));
+
+    if (argc >= 3 && strcmp(argv[1], "-b") == 0) {
+        if (argc < 4) {
+            print_usage(argv[0]);
+            return -1;
+        }
+        return build_catalog(argv[2], argv + 3, argc - 3) ? 0 : -1;
+    }
+
+    int list = 0;
+    int by_image = 0;
+    int by_addresses = 0;
+    unsigned long long image_hash = 0;
+    unsigned long low = 0, high = 0;
+    if (argc == 3 && strcmp(argv[1], "-l") == 0) {
+        list = 1;
+    } else if (argc == 4 && strcmp(argv[1], "-x") == 0 &&
+               sscanf(argv[2], "%llx", &image_hash) == 1) {
+        by_image = 1;
+    } else if (argc == 4 && strcmp(argv[1], "-q") == 0 &&
+               sscanf(argv[2], "%lx-%lx", &low, &high) == 2 && low <= high && high <= 0xFFFF) {
+        by_addresses = 1;
+    } else {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    const char * catalog_path = argv[argc - 1];
+    long size;
+    uint8_t * data = read_file(catalog_path, &size);
+    struct xrec_catalog catalog;
+    if (data == NULL) {
+        printf("Unable to open %s\n", catalog_path);
+        return -1;
+    }
+    if (!xrec_catalog_open(&catalog, data, size)) {
+        printf("%s is not a valid catalog\n", catalog_path);
+        free(data);
+        return -1;
+    }
+
+    if (list) {
+        for (long n = 0; n < catalog.tape_count; n++) {
+            print_tape(&catalog, n);
+        }
+    } else {
+        long * tapes = malloc((catalog.tape_count ? catalog.tape_count : 1) * sizeof(*tapes));
+        long found = -1;
+        if (tapes != NULL && by_image) {
+            found = xrec_catalog_find_image(&catalog, image_hash, tapes, catalog.tape_count);
+        } else if (tapes != NULL && by_addresses) {
+            found = xrec_catalog_find_addresses(&catalog, (uint16_t)low, (uint16_t)high,
+                                                tapes, catalog.tape_count);
+        }
+        if (found < 0) {
+            printf("Not enough memory to search the catalog\n");
+            free(tapes);
+            free(data);
+            return -1;
+        }
+        print_found(&catalog, tapes, found);
+        free(tapes);
+    }
+    free(data);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * xrec_checkpoint.c
+ *
+ * Checkpoints for resuming long conversions.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <string.h>
+#include "xrec_cache.h"
+#include "xrec_checkpoint.h"
+
+#define XREC_CHECKPOINT_MAGIC   "XRCK"
+
+// Magic, version, hashes, offsets, parser fields and consumer length.
+#define FIXED_SIZE      (4 + 4 + 8 + 8 + 8 + 8 + 1 + 1 + 1 + 1 + 2 + 2 + 8 + 8 + 4)
+#define TRAILER_SIZE    8
+
+static uint8_t *
+put_le (uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+    return p + bytes;
+}
+
+static uint64_t
+get_le (const uint8_t **p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) {
+        v |= (uint64_t)(*p)[i] << (8 * i);
+    }
+    *p += bytes;
+    return v;
+}
+
+void
+xrec_checkpoint_capture (struct xrec_checkpoint *checkpoint,
+                         const struct xrec_state *xrec) {
+    checkpoint->read_state = (uint8_t)xrec->read_state;
+    checkpoint->type = (uint8_t)xrec->type;
+    checkpoint->last_strict_error = (uint8_t)xrec->last_strict_error;
+    checkpoint->byte_count = (uint16_t)xrec->byte_count;
+    checkpoint->length = (uint16_t)xrec->length;
+    checkpoint->position = xrec->position;
+    checkpoint->record_offset = xrec->record_offset;
+    memcpy(checkpoint->data, xrec->data, xrec->length);
+}
+
+void
+xrec_checkpoint_restore (const struct xrec_checkpoint *checkpoint,
+                         struct xrec_state *xrec) {
+    xrec->read_state = checkpoint->read_state;
+    xrec->type = checkpoint->type;
+    xrec->last_strict_error = checkpoint->last_strict_error;
+    xrec->byte_count = checkpoint->byte_count;
+    xrec->length = checkpoint->length;
+    xrec->position = checkpoint->position;
+    xrec->record_offset = checkpoint->record_offset;
+    memcpy(xrec->data, checkpoint->data, checkpoint->length);
+}
+
+size_t
+xrec_checkpoint_serialize (const struct xrec_checkpoint *checkpoint, uint8_t *out) {
+    size_t size = FIXED_SIZE + checkpoint->length + checkpoint->consumer_length + TRAILER_SIZE;
+    if (out == NULL) {
+        return size;
+    }
+    uint8_t *p = out;
+    memcpy(p, XREC_CHECKPOINT_MAGIC, 4);
+    p = put_le(p + 4, XREC_CHECKPOINT_VERSION, 4);
+    p = put_le(p, checkpoint->input_hash, 8);
+    p = put_le(p, checkpoint->options_hash, 8);
+    p = put_le(p, checkpoint->input_offset, 8);
+    p = put_le(p, checkpoint->output_offset, 8);
+    p = put_le(p, checkpoint->read_state, 1);
+    p = put_le(p, checkpoint->type, 1);
+    p = put_le(p, checkpoint->last_strict_error, 1);
+    p = put_le(p, 0, 1);
+    p = put_le(p, checkpoint->byte_count, 2);
+    p = put_le(p, checkpoint->length, 2);
+    p = put_le(p, checkpoint->position, 8);
+    p = put_le(p, checkpoint->record_offset, 8);
+    p = put_le(p, checkpoint->consumer_length, 4);
+    memcpy(p, checkpoint->data, checkpoint->length);
+    p += checkpoint->length;
+    memcpy(p, checkpoint->consumer, checkpoint->consumer_length);
+    p += checkpoint->consumer_length;
+    put_le(p, xrec_hash_bytes(XREC_HASH_SEED, out, p - out), 8);
+    return size;
+}
+
+int
+xrec_checkpoint_deserialize (struct xrec_checkpoint *checkpoint,
+                             const uint8_t *in, size_t length) {
+    const uint8_t *p = in + 4;
+    if (length < FIXED_SIZE + TRAILER_SIZE || memcmp(in, XREC_CHECKPOINT_MAGIC, 4) != 0 ||
+        get_le(&p, 4) != XREC_CHECKPOINT_VERSION) {
+        return 0;
+    }
+    checkpoint->input_hash = get_le(&p, 8);
+    checkpoint->options_hash = get_le(&p, 8);
+    checkpoint->input_offset = get_le(&p, 8);
+    checkpoint->output_offset = get_le(&p, 8);
+    checkpoint->read_state = (uint8_t)get_le(&p, 1);
+    checkpoint->type = (uint8_t)get_le(&p, 1);
+    checkpoint->last_strict_error = (uint8_t)get_le(&p, 1);
+    p++;
+    checkpoint->byte_count = (uint16_t)get_le(&p, 2);
+    checkpoint->length = (uint16_t)get_le(&p, 2);
+    checkpoint->position = get_le(&p, 8);
+    checkpoint->record_offset = get_le(&p, 8);
+    checkpoint->consumer_length = (uint32_t)get_le(&p, 4);
+    if (checkpoint->length > XREC_RECORD_SIZE ||
+        checkpoint->consumer_length > XREC_CHECKPOINT_CONSUMER_MAX ||
+        length != FIXED_SIZE + checkpoint->length + checkpoint->consumer_length + TRAILER_SIZE) {
+        return 0;
+    }
+    memcpy(checkpoint->data, p, checkpoint->length);
+    p += checkpoint->length;
+    memcpy(checkpoint->consumer, p, checkpoint->consumer_length);
+    p += checkpoint->consumer_length;
+    uint64_t hash = xrec_hash_bytes(XREC_HASH_SEED, in, p - in);
+    return get_le(&p, 8) == hash;
+}
@@ -0,0 +1,89 @@
+/*
+ * xrec_checkpoint.h
+ *
+ * Checkpoints for long conversions: the parser state, how far the
+ * conversion had got through its input and output, and whatever the
+ * consumer of the records needs to carry on from there. A run that is
+ * interrupted can then resume from its last checkpoint instead of parsing
+ * the input again from the start.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * A convenient time to take a checkpoint is between records, e.g. after a
+ * callback has returned XREC_PAUSE, once the output so far has been flushed:
+ *
+ *      struct xrec_checkpoint checkpoint;
+ *      xrec_checkpoint_capture(&checkpoint, &xrec);
+ *      checkpoint.options_hash = ... a hash of the options ...;
+ *      checkpoint.input_offset = bytes_consumed;
+ *      checkpoint.output_offset = bytes_written;
+ *      ... copy the consumer's own state into checkpoint.consumer ...
+ *      xrec_checkpoint_serialize(&checkpoint, buffer);
+ *
+ * To resume, deserialize it, check that the input and options hashes
+ * match, restore the parser with
+ * `xrec_checkpoint_restore` (after `xrec_begin_read` and setting the
+ * context and callback), cut the output back to `output_offset` and feed
+ * the parser the input from `input_offset` on. Any state can be captured,
+ * even part way through a record.
+ *
+ * The serialized form is "XRCK", a version number and the fields below,
+ * all little-endian, followed by a hash of everything before it so that a
+ * damaged checkpoint is rejected rather than resumed from.
+ */
+
+#ifndef XREC_CHECKPOINT_H
+#define XREC_CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "xrec.h"
+
+#define XREC_CHECKPOINT_VERSION         2
+#define XREC_CHECKPOINT_CONSUMER_MAX    256
+
+struct xrec_checkpoint {
+    uint64_t    input_hash;     // Identifies the input, e.g. by xrec_hash_bytes
+    uint64_t    options_hash;   // Identifies the settings that shape the output
+    uint64_t    input_offset;   // Input bytes consumed
+    uint64_t    output_offset;  // Output bytes written
+
+    // The parser, less its context and callback.
+    uint8_t     read_state;
+    uint8_t     type;
+    uint8_t     last_strict_error;
+    uint16_t    byte_count;
+    uint16_t    length;
+    uint64_t    position;
+    uint64_t    record_offset;
+    uint8_t     data[XREC_RECORD_SIZE];
+
+    // The consumer's state, in whatever form it likes.
+    uint32_t    consumer_length;
+    uint8_t     consumer[XREC_CHECKPOINT_CONSUMER_MAX];
+};
+
+// Copy the state of a parser into a checkpoint.
+void xrec_checkpoint_capture(struct xrec_checkpoint *checkpoint,
+                             const struct xrec_state *xrec);
+
+// Put a parser back into the state held by a checkpoint. Its context and
+// callback are left as they are.
+void xrec_checkpoint_restore(const struct xrec_checkpoint *checkpoint,
+                             struct xrec_state *xrec);
+
+// Write the checkpoint to `out` and return its size. If `out` is NULL, just
+// return the size needed.
+size_t xrec_checkpoint_serialize(const struct xrec_checkpoint *checkpoint, uint8_t *out);
+
+// Read a checkpoint written by `xrec_checkpoint_serialize`. Returns nonzero
+// on success.
+int xrec_checkpoint_deserialize(struct xrec_checkpoint *checkpoint,
+                                const uint8_t *in, size_t length);
+
+#endif
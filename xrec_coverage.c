@@ -0,0 +1,160 @@
+/*
+ * xrec_coverage.c
+ *
+ * Address coverage analysis with a 64K bitmap.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <string.h>
+#include "xrec_coverage.h"
+
+#define ADDRESSES   0x10000L
+
+static int
+lowest_bit (uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static int
+count_bits (uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#else
+    int count = 0;
+    for (; word; word &= word - 1) {
+        count++;
+    }
+    return count;
+#endif
+}
+
+// Mark `first` up to (but not including) `end`, which don't wrap.
+static void
+add_range (struct xrec_coverage *coverage, long first, long end) {
+    for (long w = first >> 6; w <= (end - 1) >> 6; w++) {
+        long low = first > (w << 6) ? first - (w << 6) : 0;
+        long high = end < ((w + 1) << 6) ? end - (w << 6) : 64;
+        uint64_t mask = high - low == 64 ? ~0ULL : ((1ULL << (high - low)) - 1) << low;
+        uint64_t again = coverage->written[w] & mask;
+        coverage->written[w] |= mask;
+        if (again) {
+            coverage->overlap[w] |= again;
+            for (; again; again &= again - 1) {
+                uint8_t *rewrites = &coverage->rewrites[(w << 6) + lowest_bit(again)];
+                if (*rewrites < 255) {
+                    ++*rewrites;
+                }
+            }
+        }
+    }
+}
+
+// Find the first address from `from` up to `limit` whose bit, after
+// flipping by `flip`, is set. Returns `limit` if there is none.
+static long
+find_bit (const uint64_t *bits, uint64_t flip, long from, long limit) {
+    while (from < limit) {
+        long w = from >> 6;
+        uint64_t word = (bits[w] ^ flip) & (~0ULL << (from & 63));
+        if (word) {
+            long found = (w << 6) + lowest_bit(word);
+            return found < limit ? found : limit;
+        }
+        from = (w + 1) << 6;
+    }
+    return limit;
+}
+
+// The highest written address, or -1 if nothing was written.
+static long
+last_written (const struct xrec_coverage *coverage) {
+    for (long w = XREC_COVERAGE_WORDS - 1; w >= 0; w--) {
+        uint64_t word = coverage->written[w];
+        if (word) {
+            int bit = 63;
+            while (!(word >> bit)) {
+                bit--;
+            }
+            return (w << 6) + bit;
+        }
+    }
+    return -1;
+}
+
+void
+xrec_coverage_init (struct xrec_coverage *coverage) {
+    memset(coverage, 0, sizeof(*coverage));
+}
+
+void
+xrec_coverage_add (struct xrec_coverage *coverage, uint16_t address, int length) {
+    if (length <= 0) {
+        return;
+    }
+    long end = (long)address + length;
+    if (end > ADDRESSES) {
+        add_range(coverage, address, ADDRESSES);
+        add_range(coverage, 0, end - ADDRESSES);
+    } else {
+        add_range(coverage, address, end);
+    }
+    coverage->records++;
+}
+
+long
+xrec_coverage_total (const struct xrec_coverage *coverage, enum xrec_coverage_kind kind) {
+    const uint64_t *bits = kind == XREC_COVERAGE_OVERLAP ? coverage->overlap : coverage->written;
+    long total = 0;
+    for (long w = 0; w < XREC_COVERAGE_WORDS; w++) {
+        total += count_bits(bits[w]);
+    }
+    if (kind == XREC_COVERAGE_GAP) {
+        long last = last_written(coverage);
+        long first = find_bit(coverage->written, 0, 0, ADDRESSES);
+        total = last < 0 ? 0 : last - first + 1 - total;
+    }
+    return total;
+}
+
+long
+xrec_coverage_next_range (const struct xrec_coverage *coverage,
+                          enum xrec_coverage_kind kind, long from,
+                          uint16_t *low, uint16_t *high) {
+    const uint64_t *bits = kind == XREC_COVERAGE_OVERLAP ? coverage->overlap : coverage->written;
+    uint64_t flip = kind == XREC_COVERAGE_GAP ? ~0ULL : 0;
+    long limit = ADDRESSES;
+    if (kind == XREC_COVERAGE_GAP) {
+        // Only the gaps between the lowest and highest written addresses.
+        long first = find_bit(coverage->written, 0, 0, ADDRESSES);
+        if (from < first) {
+            from = first;
+        }
+        limit = last_written(coverage) + 1;
+    }
+    long start = find_bit(bits, flip, from, limit);
+    if (start >= limit) {
+        return -1;
+    }
+    long end = find_bit(bits, ~flip, start, limit);
+    *low = (uint16_t)start;
+    *high = (uint16_t)(end - 1);
+    return end;
+}
+
+int
+xrec_coverage_count (const struct xrec_coverage *coverage, uint16_t address) {
+    int written = (coverage->written[address >> 6] >> (address & 63)) & 1;
+    return written ? 1 + coverage->rewrites[address] : 0;
+}
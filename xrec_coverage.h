@@ -0,0 +1,74 @@
+/*
+ * xrec_coverage.h
+ *
+ * Address coverage analysis: which addresses the records of a tape write,
+ * which they write more than once, and where the gaps are. Overlapping
+ * records often mean corruption or a multi-stage loader.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * Add each data record from within the `xrec_data_read` callback:
+ *
+ *      xrec_coverage_add(&coverage, address, length);
+ *
+ * then walk the ranges of interest once parsing is done:
+ *
+ *      uint16_t low, high;
+ *      long next = 0;
+ *      while ((next = xrec_coverage_next_range(&coverage, XREC_COVERAGE_OVERLAP,
+ *                                              next, &low, &high)) >= 0) {
+ *          // $low-$high were written more than once
+ *      }
+ *
+ * Written addresses are kept in a 65,536-bit bitmap, and addresses written
+ * again in a second one, both updated a 64-bit word at a time. Only bytes
+ * that are written more than once touch the per-byte counts, so the cost of
+ * a tape without overlaps is a few word operations per record.
+ */
+
+#ifndef XREC_COVERAGE_H
+#define XREC_COVERAGE_H
+
+#include <stdint.h>
+
+#define XREC_COVERAGE_WORDS     (0x10000 / 64)
+
+enum xrec_coverage_kind {
+    XREC_COVERAGE_WRITTEN,      // Written at least once
+    XREC_COVERAGE_OVERLAP,      // Written more than once
+    XREC_COVERAGE_GAP           // Not written, but between written addresses
+};
+
+struct xrec_coverage {
+    uint64_t    written[XREC_COVERAGE_WORDS];
+    uint64_t    overlap[XREC_COVERAGE_WORDS];
+    uint8_t     rewrites[0x10000];  // Writes after the first, up to 255
+    long        records;
+};
+
+// Start with nothing written.
+void xrec_coverage_init(struct xrec_coverage *coverage);
+
+// Record that `length` bytes were written from `address` on. Writes that
+// run past $FFFF wrap around to $0000, as they would in memory.
+void xrec_coverage_add(struct xrec_coverage *coverage, uint16_t address, int length);
+
+// Number of distinct addresses of the given kind.
+long xrec_coverage_total(const struct xrec_coverage *coverage, enum xrec_coverage_kind kind);
+
+// Find the first range of the given kind that starts at or after `from`
+// (0 to 0x10000). Sets `*low` and `*high` and returns where to continue
+// from, or returns -1 if there are no more.
+long xrec_coverage_next_range(const struct xrec_coverage *coverage,
+                              enum xrec_coverage_kind kind, long from,
+                              uint16_t *low, uint16_t *high);
+
+// How many times `address` was written, up to 256.
+int xrec_coverage_count(const struct xrec_coverage *coverage, uint16_t address);
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * xrec_dedupe.c
+ *
+ * Suppression of duplicate records.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <stdlib.h>
+#include "xrec_cache.h"
+#include "xrec_dedupe.h"
+
+#define INITIAL_SLOTS   1024
+
+// What is known about all the records of one address and length.
+enum span_state {
+    SPAN_VALID = 1,     // A valid copy has been seen
+    SPAN_FAILED         // Only copies that failed their checksum have been seen
+};
+
+static int
+table_init (struct xrec_dedupe_table *table, unsigned long slots) {
+    table->entries = calloc(slots, sizeof(*table->entries));
+    table->mask = slots - 1;
+    table->count = 0;
+    return table->entries != NULL;
+}
+
+// Find the slot for `key`: either the one holding it or the empty one where
+// it belongs.
+static struct xrec_dedupe_entry *
+table_find (const struct xrec_dedupe_table *table, uint64_t key) {
+    unsigned long i = (unsigned long)key & table->mask;
+    while (table->entries[i].key != 0 && table->entries[i].key != key) {
+        i = (i + 1) & table->mask;
+    }
+    return &table->entries[i];
+}
+
+// Make room for one more entry, keeping the table at most half full.
+// Returns nonzero on success.
+static int
+table_reserve (struct xrec_dedupe_table *table) {
+    if ((table->count + 1) * 2 <= table->mask + 1) {
+        return 1;
+    }
+    struct xrec_dedupe_table grown;
+    if (!table_init(&grown, (table->mask + 1) * 2)) {
+        return 0;
+    }
+    for (unsigned long i = 0; i <= table->mask; i++) {
+        if (table->entries[i].key != 0) {
+            *table_find(&grown, table->entries[i].key) = table->entries[i];
+        }
+    }
+    grown.count = table->count;
+    free(table->entries);
+    *table = grown;
+    return 1;
+}
+
+// Add `key`, which must not already be present. Returns the new entry, or
+// NULL if there isn't enough memory.
+static struct xrec_dedupe_entry *
+table_add (struct xrec_dedupe_table *table, uint64_t key, unsigned long offset, int state) {
+    if (!table_reserve(table)) {
+        return NULL;
+    }
+    struct xrec_dedupe_entry *entry = table_find(table, key);
+    entry->key = key;
+    entry->offset = offset;
+    entry->state = state;
+    table->count++;
+    return entry;
+}
+
+// Keys are never 0, which marks an empty slot.
+static uint64_t
+record_key (uint16_t address, int length, const uint8_t *data, int payload) {
+    uint8_t header[4] = { address >> 8, address & 0xFF, length >> 8, length & 0xFF };
+    uint64_t key = xrec_hash_bytes(XREC_HASH_SEED, header, sizeof(header));
+    if (payload) {
+        key = xrec_hash_bytes(key, data, length);
+    }
+    return key ? key : 1;
+}
+
+int
+xrec_dedupe_init (struct xrec_dedupe *dedupe) {
+    dedupe->duplicates = 0;
+    dedupe->fixed = 0;
+    if (!table_init(&dedupe->contents, INITIAL_SLOTS)) {
+        return 0;
+    }
+    if (!table_init(&dedupe->spans, INITIAL_SLOTS)) {
+        free(dedupe->contents.entries);
+        return 0;
+    }
+    return 1;
+}
+
+void
+xrec_dedupe_free (struct xrec_dedupe *dedupe) {
+    free(dedupe->contents.entries);
+    free(dedupe->spans.entries);
+    dedupe->contents.entries = NULL;
+    dedupe->spans.entries = NULL;
+}
+
+enum xrec_dedupe_result
+xrec_dedupe_check (struct xrec_dedupe *dedupe,
+                   const struct xrec_state *xrec,
+                   uint16_t address,
+                   const uint8_t *data,
+                   int length,
+                   int checksum_error,
+                   unsigned long *failed_offset) {
+    unsigned long offset = (unsigned long)xrec->record_offset;
+    uint64_t span_key = record_key(address, length, data, 0);
+    struct xrec_dedupe_entry *span = table_find(&dedupe->spans, span_key);
+
+    if (checksum_error) {
+        if (span->key == 0) {
+            table_add(&dedupe->spans, span_key, offset, SPAN_FAILED);
+            return XREC_DEDUPE_NEW;
+        }
+        if (span->state == SPAN_VALID) {
+            dedupe->duplicates++;
+            return XREC_DEDUPE_DUPLICATE;
+        }
+        return XREC_DEDUPE_NEW;
+    }
+
+    uint64_t content_key = record_key(address, length, data, 1);
+    if (table_find(&dedupe->contents, content_key)->key != 0) {
+        dedupe->duplicates++;
+        return XREC_DEDUPE_DUPLICATE;
+    }
+    table_add(&dedupe->contents, content_key, offset, SPAN_VALID);
+
+    if (span->key == 0) {
+        table_add(&dedupe->spans, span_key, offset, SPAN_VALID);
+        return XREC_DEDUPE_NEW;
+    }
+    if (span->state == SPAN_FAILED) {
+        span->state = SPAN_VALID;
+        *failed_offset = span->offset;
+        dedupe->fixed++;
+        return XREC_DEDUPE_FIXED;
+    }
+    return XREC_DEDUPE_NEW;
+}
@@ -0,0 +1,87 @@
+/*
+ * xrec_dedupe.h
+ *
+ * Suppression of duplicate records, for tapes that carry more than one copy
+ * of the same program.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * Check each data record from within the `xrec_data_read` callback:
+ *
+ *      unsigned long failed_offset;
+ *      enum xrec_dedupe_result result = xrec_dedupe_check(&dedupe, xrec, address, data,
+ *                                                         length, checksum_error,
+ *                                                         &failed_offset);
+ *      if (result == XREC_DEDUPE_DUPLICATE) {
+ *          return XREC_CONTINUE;   // Already have this one
+ *      }
+ *      if (result == XREC_DEDUPE_FIXED) {
+ *          // The copy at input offset `failed_offset` failed its checksum,
+ *          // and this valid copy replaces it.
+ *      }
+ *
+ * A valid record is a duplicate if a valid record with the same address and
+ * payload has been seen before. A record that fails its checksum is a
+ * duplicate if a valid record of the same address and length has been seen,
+ * since the valid one is much more likely to be right.
+ *
+ * Records are identified by a 64-bit FNV-1a hash of their address, length
+ * and payload, kept in small open-addressing tables that grow as needed.
+ */
+
+#ifndef XREC_DEDUPE_H
+#define XREC_DEDUPE_H
+
+#include <stdint.h>
+#include "xrec.h"
+
+enum xrec_dedupe_result {
+    XREC_DEDUPE_NEW = 0,        // Not seen before
+    XREC_DEDUPE_DUPLICATE,      // Repeats a valid record already seen
+    XREC_DEDUPE_FIXED           // A valid copy of a record that earlier failed its checksum
+};
+
+struct xrec_dedupe_entry {
+    uint64_t        key;        // 0 if the slot is empty
+    unsigned long   offset;     // Input offset of the record's first copy
+    int             state;
+};
+
+struct xrec_dedupe_table {
+    struct xrec_dedupe_entry *  entries;
+    unsigned long               mask;       // Slots - 1; the slot count is a power of two
+    unsigned long               count;
+};
+
+struct xrec_dedupe {
+    struct xrec_dedupe_table    contents;   // Valid records by address, length and payload
+    struct xrec_dedupe_table    spans;      // All records by address and length
+    long                        duplicates;
+    long                        fixed;
+};
+
+// Set up an empty set of tables. Returns nonzero on success.
+int xrec_dedupe_init(struct xrec_dedupe *dedupe);
+
+// Release the tables.
+void xrec_dedupe_free(struct xrec_dedupe *dedupe);
+
+// Check a data record and remember it. `xrec` is the parser delivering it,
+// whose record offset identifies the record in reports. If the result is
+// XREC_DEDUPE_FIXED, `*failed_offset` is set to the input offset of the
+// copy that failed. Records are treated as new if there isn't enough memory
+// to remember them.
+enum xrec_dedupe_result xrec_dedupe_check(struct xrec_dedupe *dedupe,
+                                          const struct xrec_state *xrec,
+                                          uint16_t address,
+                                          const uint8_t *data,
+                                          int length,
+                                          int checksum_error,
+                                          unsigned long *failed_offset);
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * xrec_fingerprint.c
+ *
+ * Hashes of the loaded memory image.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <string.h>
+#include "xrec_fingerprint.h"
+#include "xrec_kernels.h"
+
+#define ADDRESSES   0x10000L
+
+#define PRIME64_1   0x9E3779B185EBCA87ULL
+#define PRIME64_2   0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3   0x165667B19E3779F9ULL
+#define PRIME64_4   0x85EBCA77C2B2AE63ULL
+#define PRIME64_5   0x27D4EB2F165667C5ULL
+
+static uint64_t
+rotl64 (uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static uint64_t
+read64 (const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static uint64_t
+read32 (const uint8_t *p) {
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24);
+}
+
+static uint64_t
+xxh64_round (uint64_t lane, uint64_t input) {
+    lane += input * PRIME64_2;
+    return rotl64(lane, 31) * PRIME64_1;
+}
+
+static uint64_t
+xxh64_merge (uint64_t hash, uint64_t lane) {
+    hash ^= xxh64_round(0, lane);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+// Consume whole 32-byte stripes, returning how many bytes that was.
+static size_t
+xxh64_stripes (uint64_t lanes[4], const uint8_t *data, size_t length) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        lanes[0] = xxh64_round(lanes[0], read64(data + i));
+        lanes[1] = xxh64_round(lanes[1], read64(data + i + 8));
+        lanes[2] = xxh64_round(lanes[2], read64(data + i + 16));
+        lanes[3] = xxh64_round(lanes[3], read64(data + i + 24));
+    }
+    return i;
+}
+
+void
+xrec_xxh64_init (struct xrec_xxh64 *state, uint64_t seed) {
+    state->seed = seed;
+    state->lanes[0] = seed + PRIME64_1 + PRIME64_2;
+    state->lanes[1] = seed + PRIME64_2;
+    state->lanes[2] = seed;
+    state->lanes[3] = seed - PRIME64_1;
+    state->total = 0;
+    state->buffered = 0;
+}
+
+void
+xrec_xxh64_update (struct xrec_xxh64 *state, const uint8_t *data, size_t length) {
+    state->total += length;
+    if (state->buffered + length < 32) {
+        memcpy(state->buffer + state->buffered, data, length);
+        state->buffered += (int)length;
+        return;
+    }
+    if (state->buffered > 0) {
+        size_t fill = 32 - state->buffered;
+        memcpy(state->buffer + state->buffered, data, fill);
+        xxh64_stripes(state->lanes, state->buffer, 32);
+        data += fill;
+        length -= fill;
+    }
+    size_t done = xxh64_stripes(state->lanes, data, length);
+    state->buffered = (int)(length - done);
+    memcpy(state->buffer, data + done, state->buffered);
+}
+
+uint64_t
+xrec_xxh64_digest (const struct xrec_xxh64 *state) {
+    const uint64_t *lanes = state->lanes;
+    uint64_t hash;
+    if (state->total >= 32) {
+        hash = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) + rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+        for (int i = 0; i < 4; i++) {
+            hash = xxh64_merge(hash, lanes[i]);
+        }
+    } else {
+        hash = state->seed + PRIME64_5;
+    }
+    hash += state->total;
+
+    const uint8_t *p = state->buffer;
+    const uint8_t *end = p + state->buffered;
+    for (; p + 8 <= end; p += 8) {
+        hash ^= xxh64_round(0, read64(p));
+        hash = rotl64(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        hash ^= read32(p) * PRIME64_1;
+        hash = rotl64(hash, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        hash ^= *p * PRIME64_5;
+        hash = rotl64(hash, 11) * PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Hash a run of bytes, starting a new range at `address` if `start` is set.
+static void
+hash_bytes (struct xrec_fingerprint *fingerprint, int start, uint16_t address,
+            const uint8_t *data, size_t length) {
+    if (start) {
+        uint8_t header[2] = { address >> 8, address & 0xFF };
+        fingerprint->crc32 = xrec_kernels->crc32(fingerprint->crc32, header, sizeof(header));
+        xrec_xxh64_update(&fingerprint->xxh64, header, sizeof(header));
+    }
+    fingerprint->crc32 = xrec_kernels->crc32(fingerprint->crc32, data, length);
+    xrec_xxh64_update(&fingerprint->xxh64, data, length);
+}
+
+static void
+reset_hashes (struct xrec_fingerprint *fingerprint) {
+    fingerprint->crc32 = 0;
+    xrec_xxh64_init(&fingerprint->xxh64, 0);
+}
+
+void
+xrec_fingerprint_init (struct xrec_fingerprint *fingerprint) {
+    xrec_coverage_init(&fingerprint->coverage);
+    fingerprint->hashed = -1;
+    fingerprint->reordered = 0;
+    reset_hashes(fingerprint);
+}
+
+void
+xrec_fingerprint_add (struct xrec_fingerprint *fingerprint, uint16_t address,
+                      const uint8_t *data, int length) {
+    if (length <= 0) {
+        return;
+    }
+    xrec_coverage_add(&fingerprint->coverage, address, length);
+    long end = (long)address + length;
+    if (end > ADDRESSES) {
+        long first = ADDRESSES - address;
+        memcpy(fingerprint->memory + address, data, first);
+        memcpy(fingerprint->memory, data + first, length - first);
+        fingerprint->reordered = 1;
+        return;
+    }
+    memcpy(fingerprint->memory + address, data, length);
+
+    // Keep hashing as long as the records only go upwards.
+    if (fingerprint->reordered || address < fingerprint->hashed) {
+        fingerprint->reordered = 1;
+        return;
+    }
+    hash_bytes(fingerprint, address != fingerprint->hashed, address, data, length);
+    fingerprint->hashed = end;
+}
+
+void
+xrec_fingerprint_finish (struct xrec_fingerprint *fingerprint,
+                         uint32_t *crc32, uint64_t *xxh64) {
+    if (fingerprint->reordered) {
+        reset_hashes(fingerprint);
+        fingerprint->hashed = -1;
+        uint16_t low, high;
+        long next = 0;
+        while ((next = xrec_coverage_next_range(&fingerprint->coverage, XREC_COVERAGE_WRITTEN,
+                                                next, &low, &high)) >= 0) {
+            hash_bytes(fingerprint, 1, low, fingerprint->memory + low, (size_t)high - low + 1);
+            fingerprint->hashed = next;
+        }
+        fingerprint->reordered = 0;
+    }
+    *crc32 = fingerprint->crc32;
+    *xxh64 = xrec_xxh64_digest(&fingerprint->xxh64);
+}
@@ -0,0 +1,78 @@
+/*
+ * xrec_fingerprint.h
+ *
+ * CRC-32 and XXH64 hashes of the memory image a tape loads, computed as the
+ * records arrive, for cataloguing tapes by what they load rather than by
+ * the bytes of the capture.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * Add each data record from within the `xrec_data_read` callback:
+ *
+ *      xrec_fingerprint_add(fingerprint, address, data, length);
+ *
+ * then collect the hashes once parsing is done:
+ *
+ *      uint32_t crc32;
+ *      uint64_t xxh64;
+ *      xrec_fingerprint_finish(fingerprint, &crc32, &xxh64);
+ *
+ * The image is what memory holds after loading, with later records
+ * overwriting earlier ones. It is hashed as its written ranges in address
+ * order, each as its start address (2 bytes, high byte first) followed by
+ * its bytes, so two tapes that load the same bytes at the same addresses
+ * get the same hashes however their records were arranged.
+ *
+ * Most tapes load upwards without going back, and those are hashed record
+ * by record as they arrive, leaving nothing to do at the end. A tape that
+ * goes back over addresses already hashed is hashed again in one pass over
+ * the image by `xrec_fingerprint_finish`.
+ */
+
+#ifndef XREC_FINGERPRINT_H
+#define XREC_FINGERPRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "xrec_coverage.h"
+
+// Streaming XXH64 state.
+struct xrec_xxh64 {
+    uint64_t    seed;
+    uint64_t    lanes[4];
+    uint64_t    total;
+    uint8_t     buffer[32];
+    int         buffered;
+};
+
+struct xrec_fingerprint {
+    struct xrec_coverage    coverage;       // The addresses written
+    uint8_t                 memory[0x10000];
+    long                    hashed;         // Addresses below this are hashed, or -1
+    int                     reordered;      // Nonzero if a record went back below `hashed`
+    uint32_t                crc32;
+    struct xrec_xxh64       xxh64;
+};
+
+// Start with an empty image.
+void xrec_fingerprint_init(struct xrec_fingerprint *fingerprint);
+
+// Load `length` bytes at `address`, wrapping past $FFFF.
+void xrec_fingerprint_add(struct xrec_fingerprint *fingerprint, uint16_t address,
+                          const uint8_t *data, int length);
+
+// Finish hashing the image loaded so far.
+void xrec_fingerprint_finish(struct xrec_fingerprint *fingerprint,
+                             uint32_t *crc32, uint64_t *xxh64);
+
+// XXH64 of a stream of bytes, for use on its own.
+void xrec_xxh64_init(struct xrec_xxh64 *state, uint64_t seed);
+void xrec_xxh64_update(struct xrec_xxh64 *state, const uint8_t *data, size_t length);
+uint64_t xrec_xxh64_digest(const struct xrec_xxh64 *state);
+
+#endif
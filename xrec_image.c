@@ -0,0 +1,225 @@
+/*
+ * xrec_image.c
+ *
+ * Random access to the memory image loaded by an xrec file.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xrec_image.h"
+
+// The furthest into a file that the parser can report a record's offset.
+#ifdef XREC_COMPACT_STATE
+#define MAX_RECORD_OFFSET   UINT32_MAX
+#else
+#define MAX_RECORD_OFFSET   ULONG_MAX
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define XREC_IMAGE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <stdio.h>
+#endif
+
+struct image_read {
+    uint16_t    low;
+    int         length;
+    uint8_t *   out;
+    uint8_t *   loaded;     // Bitmap of the bytes of `out` loaded so far
+};
+
+static int
+map_file (struct xrec_image *image, const char *path) {
+#ifdef XREC_IMAGE_MMAP
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return 0;
+    }
+    image->size = (size_t)info.st_size;
+    if (image->size == 0) {
+        // Zero-length mappings are not allowed; there is nothing to read anyway.
+        image->data = NULL;
+        close(fd);
+        return 1;
+    }
+    void *data = mmap(NULL, image->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+    image->data = data;
+    image->mapped = 1;
+    return 1;
+#else
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    int success = fseek(file, 0, SEEK_END) == 0;
+    long size = success ? ftell(file) : -1;
+    uint8_t *data = size >= 0 ? malloc(size ? size : 1) : NULL;
+    success = data != NULL && fseek(file, 0, SEEK_SET) == 0 &&
+              fread(data, 1, size, file) == (size_t)size;
+    fclose(file);
+    if (!success) {
+        free(data);
+        return 0;
+    }
+    image->data = data;
+    image->size = (size_t)size;
+    return 1;
+#endif
+}
+
+static enum xrec_action
+index_record (struct xrec_state *xrec,
+              int record_type,
+              uint16_t address,
+              uint8_t *data,
+              int length,
+              int checksum_error) {
+    struct xrec_image *image = xrec->context;
+    (void)data;
+    if (!xrec_index_add(&image->index, xrec, record_type, address, length, checksum_error)) {
+        image->indexed = -1;
+        return XREC_STOP;
+    }
+    return XREC_CONTINUE;
+}
+
+static enum xrec_action
+load_record (struct xrec_state *xrec,
+             int record_type,
+             uint16_t address,
+             uint8_t *data,
+             int length,
+             int checksum_error) {
+    struct image_read *read = xrec->context;
+    (void)checksum_error;
+    if (record_type != XREC_DATA_16BIT) {
+        return XREC_CONTINUE;
+    }
+    for (int i = 0; i < length; i++) {
+        int offset = (uint16_t)(address + i) - read->low;
+        if (offset >= 0 && offset < read->length) {
+            read->out[offset] = data[i];
+            read->loaded[offset >> 3] |= (uint8_t)(1 << (offset & 7));
+        }
+    }
+    return XREC_CONTINUE;
+}
+
+struct xrec_image *
+xrec_image_open (const char *path) {
+    struct xrec_image *image = calloc(1, sizeof(*image));
+    if (image == NULL) {
+        return NULL;
+    }
+    xrec_index_init(&image->index);
+    if (!map_file(image, path)) {
+        free(image);
+        return NULL;
+    }
+    // Records beyond that couldn't be found again.
+    if (image->size > 0 && image->size - 1 > MAX_RECORD_OFFSET) {
+        xrec_image_close(image);
+        return NULL;
+    }
+    return image;
+}
+
+const struct xrec_index *
+xrec_image_index (struct xrec_image *image) {
+    if (!image->indexed) {
+        struct xrec_state xrec;
+        xrec_begin_read(&xrec);
+#ifdef XREC_COMPACT_STATE
+        uint8_t record[XREC_RECORD_SIZE];
+        xrec.data = record;
+#endif
+        xrec.context = image;
+        xrec.callback = index_record;
+        for (size_t offset = 0; image->indexed == 0 && offset < image->size; offset += 0x40000000) {
+            size_t count = image->size - offset;
+            if (count > 0x40000000) {
+                count = 0x40000000;
+            }
+            xrec_read_bytes(&xrec, (const char *)image->data + offset, (int)count);
+        }
+        if (image->indexed == 0) {
+            image->indexed = 1;
+        }
+    }
+    return image->indexed > 0 ? &image->index : NULL;
+}
+
+int
+xrec_image_read (struct xrec_image *image, uint16_t address, uint8_t *out, int length) {
+    const struct xrec_index *index = xrec_image_index(image);
+    if (index == NULL) {
+        return -1;
+    }
+    if (length > 0x10000 - address) {
+        length = 0x10000 - address;
+    }
+    if (length <= 0) {
+        return 0;
+    }
+
+    uint8_t loaded[0x10000 / 8];
+    struct image_read read = { address, length, out, loaded };
+    memset(loaded, 0, (length + 7) / 8);
+
+    struct xrec_state xrec;
+    xrec_begin_read(&xrec);
+#ifdef XREC_COMPACT_STATE
+    uint8_t record[XREC_RECORD_SIZE];
+    xrec.data = record;
+#endif
+    xrec.context = &read;
+    xrec.callback = load_record;
+    uint16_t high = (uint16_t)(address + length - 1);
+    for (long i = -1; (i = xrec_index_find(index, address, high, i)) >= 0; ) {
+        const struct xrec_index_entry *entry = &index->entries[i];
+        size_t size = XREC_INDEX_RECORD_SIZE(entry->length);
+        if (entry->offset + size <= image->size) {
+            xrec_read_bytes(&xrec, (const char *)image->data + entry->offset, (int)size);
+        }
+    }
+
+    int count = 0;
+    for (int i = 0; i < length; i++) {
+        count += (loaded[i >> 3] >> (i & 7)) & 1;
+    }
+    return count;
+}
+
+void
+xrec_image_close (struct xrec_image *image) {
+    if (image == NULL) {
+        return;
+    }
+#ifdef XREC_IMAGE_MMAP
+    if (image->mapped) {
+        munmap((void *)image->data, image->size);
+    }
+#else
+    free((void *)image->data);
+#endif
+    xrec_index_free(&image->index);
+    free(image);
+}
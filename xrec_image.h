@@ -0,0 +1,66 @@
+/*
+ * xrec_image.h
+ *
+ * Random access to the memory image loaded by an xrec file, decoding only
+ * the records needed to answer each read.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ *      struct xrec_image *image = xrec_image_open("capture.bin");
+ *      uint8_t memory[0x2000];
+ *      int loaded = xrec_image_read(image, 0x0000, memory, sizeof(memory));
+ *      xrec_image_close(image);
+ *
+ * The file is memory-mapped where the platform allows it. Opening is cheap:
+ * the record index (see xrec_index.h) is only built by the first read, by a
+ * scan of the file that records where each record lives without keeping any
+ * of its data. Each read then decodes just the records that overlap the
+ * requested range, applying them in tape order so that later records
+ * overwrite earlier ones, as they would when loaded into a real machine.
+ * Bytes not loaded by any record are left untouched in the caller's buffer.
+ *
+ * Index offsets are 64-bit, so captures of any size can be read, as long
+ * as the parser's record offsets reach their end: files over 4 GB are
+ * refused when built with XREC_COMPACT_STATE, or where long is 32 bits.
+ *
+ * Records that fail their checksum are still applied, as the converter does.
+ * Their status is available in the index if the caller wants to be choosy.
+ */
+
+#ifndef XREC_IMAGE_H
+#define XREC_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "xrec_index.h"
+
+struct xrec_image {
+    const uint8_t *     data;
+    size_t              size;
+    int                 mapped;     // Nonzero if `data` is a memory mapping
+    int                 indexed;    // 1 once `index` is built, -1 if building it failed
+    struct xrec_index   index;
+};
+
+// Open an xrec file. Returns NULL if it could not be opened or read, or is
+// too large for the parser to report its record offsets.
+struct xrec_image *xrec_image_open(const char *path);
+
+// Read `length` bytes of the loaded image starting at `address` into `out`.
+// The range may not extend past $FFFF. Returns the number of bytes in the
+// range that were loaded by some record, or -1 if the index could not be
+// built.
+int xrec_image_read(struct xrec_image *image, uint16_t address, uint8_t *out, int length);
+
+// Return the record index of the image, building it if necessary. Returns
+// NULL if it could not be built.
+const struct xrec_index *xrec_image_index(struct xrec_image *image);
+
+void xrec_image_close(struct xrec_image *image);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * xrec_index.c
+ *
+ * A compact sidecar index of the records in an xrec input.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xrec_index.h"
+
+#define XREC_INDEX_MAGIC    "XRIX"
+
+static void
+put_le16 (uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void
+put_le32 (uint8_t *p, uint32_t v) {
+    put_le16(p, (uint16_t)v);
+    put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void
+put_le64 (uint8_t *p, uint64_t v) {
+    put_le32(p, (uint32_t)v);
+    put_le32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint16_t
+get_le16 (const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t
+get_le32 (const uint8_t *p) {
+    return get_le16(p) | ((uint32_t)get_le16(p + 2) << 16);
+}
+
+static uint64_t
+get_le64 (const uint8_t *p) {
+    return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+void
+xrec_index_init (struct xrec_index *index) {
+    index->entries = NULL;
+    index->count = 0;
+    index->capacity = 0;
+}
+
+void
+xrec_index_free (struct xrec_index *index) {
+    free(index->entries);
+    xrec_index_init(index);
+}
+
+static int
+reserve (struct xrec_index *index, long count) {
+    if (count <= index->capacity) {
+        return 1;
+    }
+    long capacity = index->capacity ? index->capacity : 256;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    struct xrec_index_entry *entries = realloc(index->entries, capacity * sizeof(*entries));
+    if (entries == NULL) {
+        return 0;
+    }
+    index->entries = entries;
+    index->capacity = capacity;
+    return 1;
+}
+
+int
+xrec_index_add (struct xrec_index *index,
+                const struct xrec_state *xrec,
+                int record_type,
+                uint16_t address,
+                int length,
+                int checksum_error) {
+    if (!reserve(index, index->count + 1)) {
+        return 0;
+    }
+    struct xrec_index_entry *entry = &index->entries[index->count++];
+    entry->offset = xrec->record_offset;
+    entry->address = address;
+    entry->length = record_type == XREC_DATA_16BIT ? (uint16_t)length : 0;
+    entry->type = (uint8_t)record_type;
+    entry->status = checksum_error ? XREC_INDEX_CHECKSUM_ERROR : XREC_INDEX_OK;
+    return 1;
+}
+
+size_t
+xrec_index_serialize (const struct xrec_index *index, uint8_t *out) {
+    size_t size = XREC_INDEX_HEADER_SIZE + (size_t)index->count * XREC_INDEX_ENTRY_SIZE;
+    if (out == NULL) {
+        return size;
+    }
+    memcpy(out, XREC_INDEX_MAGIC, 4);
+    put_le32(out + 4, XREC_INDEX_VERSION);
+    put_le32(out + 8, (uint32_t)index->count);
+    out += XREC_INDEX_HEADER_SIZE;
+    for (long i = 0; i < index->count; i++) {
+        const struct xrec_index_entry *entry = &index->entries[i];
+        put_le64(out, entry->offset);
+        put_le16(out + 8, entry->address);
+        put_le16(out + 10, entry->length);
+        out[12] = entry->type;
+        out[13] = entry->status;
+        out += XREC_INDEX_ENTRY_SIZE;
+    }
+    return size;
+}
+
+int
+xrec_index_deserialize (struct xrec_index *index, const uint8_t *in, size_t length) {
+    xrec_index_init(index);
+    if (length < XREC_INDEX_HEADER_SIZE || memcmp(in, XREC_INDEX_MAGIC, 4) != 0) {
+        return 0;
+    }
+    // Version 1 has 32-bit offsets.
+    uint32_t version = get_le32(in + 4);
+    if (version != 1 && version != XREC_INDEX_VERSION) {
+        return 0;
+    }
+    int offset_size = version == 1 ? 4 : 8;
+    size_t entry_size = version == 1 ? XREC_INDEX_ENTRY_SIZE_V1 : XREC_INDEX_ENTRY_SIZE;
+    long count = get_le32(in + 8);
+    if ((length - XREC_INDEX_HEADER_SIZE) / entry_size < (size_t)count ||
+        !reserve(index, count)) {
+        return 0;
+    }
+    in += XREC_INDEX_HEADER_SIZE;
+    for (long i = 0; i < count; i++) {
+        struct xrec_index_entry *entry = &index->entries[i];
+        entry->offset = offset_size == 4 ? get_le32(in) : get_le64(in);
+        entry->address = get_le16(in + offset_size);
+        entry->length = get_le16(in + offset_size + 2);
+        entry->type = in[offset_size + 4];
+        entry->status = in[offset_size + 5];
+        in += entry_size;
+        // Refuse anything the parser could never have indexed, since the
+        // length says how many bytes to read back from the input.
+        int valid = entry->type == XREC_DATA_16BIT ?
+                    entry->length >= 1 && entry->length <= XREC_INDEX_MAX_LENGTH :
+                    entry->type == XREC_TERMINATION_16BIT;
+        if (!valid) {
+            xrec_index_free(index);
+            return 0;
+        }
+    }
+    index->count = count;
+    return 1;
+}
+
+long
+xrec_index_find (const struct xrec_index *index,
+                 uint16_t low, uint16_t high, long after) {
+    for (long i = after + 1; i < index->count; i++) {
+        const struct xrec_index_entry *entry = &index->entries[i];
+        if (entry->type != XREC_DATA_16BIT) {
+            continue;
+        }
+        // Records may wrap past $FFFF, so compare in 32 bits.
+        uint32_t first = entry->address;
+        uint32_t last = first + entry->length - 1;
+        if (first <= high && last >= low) {
+            return i;
+        }
+        if (last > 0xFFFF && last - 0x10000 >= low) {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,95 @@
+/*
+ * xrec_index.h
+ *
+ * A compact sidecar index of the records in an xrec input, so that address
+ * queries can seek straight to the relevant records instead of re-parsing.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * Build the index from within the `xrec_data_read` callback:
+ *
+ *      xrec_index_add(&index, xrec, record_type, address, length, checksum_error);
+ *
+ * and save it with `xrec_index_serialize`. Later, load it back with
+ * `xrec_index_deserialize` and walk the records that overlap an address
+ * range with `xrec_index_find`:
+ *
+ *      long i = -1;
+ *      while ((i = xrec_index_find(&index, 0x0100, 0x01FF, i)) >= 0) {
+ *          // index.entries[i].offset is the position of the record's "X"
+ *      }
+ *
+ * A record occupies XREC_INDEX_RECORD_SIZE(length) bytes of the input from
+ * its offset, so it can be decoded by feeding just those bytes to a parser.
+ *
+ * The serialized form is a 12-byte header ("XRIX", version, entry count)
+ * followed by 14 bytes per record (a 64-bit offset, address, length, type
+ * and status), all little-endian. Version 1 indexes, with 32-bit offsets
+ * and 10-byte entries, can still be loaded.
+ */
+
+#ifndef XREC_INDEX_H
+#define XREC_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "xrec.h"
+
+#define XREC_INDEX_VERSION              2
+#define XREC_INDEX_HEADER_SIZE          12
+#define XREC_INDEX_ENTRY_SIZE           14
+#define XREC_INDEX_ENTRY_SIZE_V1        10
+#define XREC_INDEX_MAX_LENGTH           256
+#define XREC_INDEX_RECORD_SIZE(length)  (2 + 1 + 2 + (length) + 1)
+
+enum xrec_index_status {
+    XREC_INDEX_OK = 0,
+    XREC_INDEX_CHECKSUM_ERROR = 1
+};
+
+struct xrec_index_entry {
+    uint64_t    offset;     // Position of the record's "X" in the input
+    uint16_t    address;
+    uint16_t    length;     // Data bytes; zero for a termination record
+    uint8_t     type;       // XREC_DATA_16BIT or XREC_TERMINATION_16BIT
+    uint8_t     status;     // enum xrec_index_status
+};
+
+struct xrec_index {
+    struct xrec_index_entry *   entries;
+    long                        count;
+    long                        capacity;
+};
+
+void xrec_index_init(struct xrec_index *index);
+void xrec_index_free(struct xrec_index *index);
+
+// Append the record just delivered to `xrec`. Returns zero if out of memory.
+int xrec_index_add(struct xrec_index *index,
+                   const struct xrec_state *xrec,
+                   int record_type,
+                   uint16_t address,
+                   int length,
+                   int checksum_error);
+
+// Write the index to `out`, or if `out` is NULL just compute its size.
+// Returns the number of bytes in the serialized index.
+size_t xrec_index_serialize(const struct xrec_index *index, uint8_t *out);
+
+// Load an index from its serialized form. Returns zero if it is malformed,
+// including any entry of an unknown type or a data length outside 1 through
+// XREC_INDEX_MAX_LENGTH, or if memory could not be allocated.
+int xrec_index_deserialize(struct xrec_index *index, const uint8_t *in, size_t length);
+
+// Find the next data record after entry `after` (or from the start, if
+// `after` is -1) that overlaps addresses `low` through `high` inclusive.
+// Returns its entry number, or -1 if there are no more.
+long xrec_index_find(const struct xrec_index *index,
+                     uint16_t low, uint16_t high, long after);
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * xrec_kcs.c
+ *
+ * A streaming Kansas City Standard / CUTS cassette demodulator.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <string.h>
+#include "xrec_kcs.h"
+
+#define KCS_ZERO_HZ         1200
+#define KCS_ONE_HZ          2400
+#define KCS_HYSTERESIS      512     // On the 16-bit sample scale
+#define KCS_BLOCK_SAMPLES   256
+
+static uint32_t
+read_le32 (const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t
+read_le16 (const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+int
+kcs_parse_wav (const uint8_t *header, long length, struct kcs_wav_format *wav) {
+    if (length < 12 || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+        return 0;
+    }
+    int have_format = 0;
+    long offset = 12;
+    while (offset + 8 <= length) {
+        const uint8_t *chunk = header + offset;
+        long chunk_length = read_le32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (chunk_length < 16 || offset + 8 + 16 > length) {
+                return 0;
+            }
+            if (read_le16(chunk + 8) != 1) {
+                return 0;   // Not uncompressed PCM
+            }
+            wav->channels = read_le16(chunk + 10);
+            wav->sample_rate = read_le32(chunk + 12);
+            wav->block_align = read_le16(chunk + 20);
+            wav->bits_per_sample = read_le16(chunk + 22);
+            have_format = 1;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            wav->data_offset = offset + 8;
+            wav->data_length = chunk_length;
+            return have_format && wav->channels > 0 &&
+                   (wav->bits_per_sample == 8 || wav->bits_per_sample == 16) &&
+                   wav->block_align == wav->channels * wav->bits_per_sample / 8;
+        }
+        // Chunks are padded to an even length.
+        offset += 8 + chunk_length + (chunk_length & 1);
+    }
+    return 0;
+}
+
+int
+kcs_begin (struct kcs_state *kcs,
+           const struct kcs_wav_format *format,
+           int baud,
+           struct xrec_state *xrec) {
+    memset(kcs, 0, sizeof(*kcs));
+    kcs->format = *format;
+    kcs->samples_per_bit = (int)((format->sample_rate + baud / 2) / baud);
+    if (kcs->samples_per_bit < 8 || kcs->samples_per_bit > KCS_MAX_SAMPLES_PER_BIT) {
+        return 0;
+    }
+
+    // Zero crossings seen in one bit period of each tone. A start bit is
+    // declared once the window is mostly low tone, and a data bit is a 1 if
+    // its window is closer to the high tone.
+    int zero_crossings = 2 * KCS_ZERO_HZ / baud;
+    int one_crossings = 2 * KCS_ONE_HZ / baud;
+    kcs->start_threshold = zero_crossings + (one_crossings - zero_crossings) / 8;
+    kcs->one_threshold = (zero_crossings + one_crossings + 1) / 2;
+    kcs->xrec = xrec;
+    return 1;
+}
+
+static void
+demodulate_sample (struct kcs_state *kcs, int sample) {
+    // Track polarity with a little hysteresis so that noise around the zero
+    // line doesn't register as extra crossings.
+    int crossing = 0;
+    if (kcs->level <= 0 && sample > KCS_HYSTERESIS) {
+        crossing = kcs->level != 0;
+        kcs->level = 1;
+    } else if (kcs->level >= 0 && sample < -KCS_HYSTERESIS) {
+        crossing = kcs->level != 0;
+        kcs->level = -1;
+    }
+
+    // Slide the one-bit window forward.
+    kcs->window_crossings += crossing - kcs->window[kcs->window_index];
+    kcs->window[kcs->window_index] = (uint8_t)crossing;
+    if (++kcs->window_index == kcs->samples_per_bit) {
+        kcs->window_index = 0;
+    }
+
+    if (kcs->bit_countdown == 0) {
+        // Idle: wait for the window to fill with the start bit's low tone.
+        if (kcs->window_crossings <= kcs->start_threshold) {
+            kcs->bit_countdown = kcs->samples_per_bit;
+            kcs->bit_index = 0;
+            kcs->shift = 0;
+        }
+        return;
+    }
+    if (--kcs->bit_countdown != 0) {
+        return;
+    }
+
+    // The window now spans exactly one bit period.
+    int bit = kcs->window_crossings >= kcs->one_threshold;
+    if (kcs->bit_index < 8) {
+        kcs->shift |= (unsigned int)bit << kcs->bit_index++;
+        kcs->bit_countdown = kcs->samples_per_bit;
+    } else if (bit) {
+        kcs->bytes_read++;
+        xrec_read_byte(kcs->xrec, (char)kcs->shift);
+    } else {
+        // Missing stop bit. Drop the byte and hunt for the next start bit.
+        kcs->framing_errors++;
+    }
+}
+
+void
+kcs_read_pcm (struct kcs_state *kcs, const uint8_t *pcm, long length) {
+    int samples[KCS_BLOCK_SAMPLES + 2];
+    int frame = kcs->format.block_align;
+    long frames = length / frame;
+
+    while (frames > 0) {
+        int count = frames < KCS_BLOCK_SAMPLES ? (int)frames : KCS_BLOCK_SAMPLES;
+
+        // Widen the first channel to the 16-bit scale, then apply a small
+        // [1 2 1] low-pass across the block. These loops are branch-free so
+        // that the compiler can vectorize them.
+        samples[0] = kcs->history[0];
+        samples[1] = kcs->history[1];
+        if (kcs->format.bits_per_sample == 8) {
+            for (int i = 0; i < count; i++) {
+                samples[i + 2] = ((int)pcm[i * frame] - 128) << 8;
+            }
+        } else {
+            for (int i = 0; i < count; i++) {
+                samples[i + 2] = (int16_t)read_le16(pcm + i * frame);
+            }
+        }
+        kcs->history[0] = samples[count];
+        kcs->history[1] = samples[count + 1];
+        for (int i = 0; i < count; i++) {
+            samples[i] = (samples[i] + 2 * samples[i + 1] + samples[i + 2]) >> 2;
+        }
+
+        for (int i = 0; i < count; i++) {
+            demodulate_sample(kcs, samples[i]);
+        }
+        pcm += (long)count * frame;
+        frames -= count;
+    }
+}
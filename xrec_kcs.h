@@ -0,0 +1,82 @@
+/*
+ * xrec_kcs.h
+ *
+ * A streaming Kansas City Standard / CUTS cassette demodulator that feeds
+ * recovered bytes directly into an xrec parser.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * The demodulator consumes PCM audio (8-bit unsigned or 16-bit signed,
+ * little-endian, any number of channels of which the first is used) and
+ * pushes each deframed byte into `xrec_read_byte`:
+ *
+ *      struct kcs_wav_format wav;
+ *      struct kcs_state kcs;
+ *      kcs_parse_wav(header, header_length, &wav);
+ *      kcs_begin(&kcs, &wav, KCS_BAUD_300, &xrec);
+ *      kcs_read_pcm(&kcs, pcm, pcm_length);   // any number of times
+ *
+ * A '0' bit is 1200 Hz and a '1' bit is 2400 Hz. Each byte is framed by one
+ * start bit (0), eight data bits (least significant first) and stop bits (1).
+ * Bits are recovered by counting zero crossings over a sliding window of one
+ * bit period, so memory use is bounded by the window regardless of input size.
+ */
+
+#ifndef XREC_KCS_H
+#define XREC_KCS_H
+
+#include <stdint.h>
+#include "xrec.h"
+
+#define KCS_BAUD_300                300     // Kansas City Standard
+#define KCS_BAUD_1200               1200    // CUTS 1200 baud
+#define KCS_MAX_SAMPLES_PER_BIT     1024
+
+struct kcs_wav_format {
+    long    sample_rate;
+    int     channels;
+    int     bits_per_sample;    // 8 or 16
+    int     block_align;        // Bytes per frame of all channels
+    long    data_offset;        // Offset of the PCM data from the start of the file
+    long    data_length;        // Length of the PCM data in bytes
+};
+
+struct kcs_state {
+    struct kcs_wav_format   format;
+    int                     samples_per_bit;
+    int                     start_threshold;    // Window crossings at or below which a start bit is seen
+    int                     one_threshold;      // Window crossings at or above which a bit is a 1
+    int                     history[2];         // Previous samples for the smoothing filter
+    int                     level;              // Current signal polarity after hysteresis
+    uint8_t                 window[KCS_MAX_SAMPLES_PER_BIT];
+    int                     window_index;
+    int                     window_crossings;
+    int                     bit_countdown;      // Samples until the next bit is sampled; 0 when idle.
+    int                     bit_index;          // 0-7 data bits, 8 stop bit
+    unsigned int            shift;
+    long                    bytes_read;
+    long                    framing_errors;
+    struct xrec_state *     xrec;
+};
+
+// Parse a RIFF/WAVE header from the start of a file. `length` bytes must
+// include everything up to the start of the PCM data. Returns nonzero if the
+// file is uncompressed 8- or 16-bit PCM.
+int kcs_parse_wav(const uint8_t *header, long length, struct kcs_wav_format *wav);
+
+// Begin demodulating audio of the given format. Returns zero if the sample
+// rate is too high or too low for the baud rate.
+int kcs_begin(struct kcs_state *kcs,
+              const struct kcs_wav_format *format,
+              int baud,
+              struct xrec_state *xrec);
+
+// Demodulate `length` bytes of PCM data, which should be whole frames.
+void kcs_read_pcm(struct kcs_state *kcs, const uint8_t *pcm, long length);
+
+#endif
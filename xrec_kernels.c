@@ -0,0 +1,431 @@
+/*
+ * xrec_kernels.c
+ *
+ * The inner loops used by the parser and formatter, with vectorized
+ * versions chosen at runtime to suit the CPU.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <string.h>
+#include "xrec_kernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define XREC_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+// CRC-32 (reflected polynomial 0xEDB88320) of each byte value.
+static const uint32_t crc32_table[256] = {
+    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
+    0xE963A535, 0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
+    0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2,
+    0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+    0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9,
+    0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
+    0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C,
+    0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+    0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423,
+    0xCFBA9599, 0xB8BDA50F, 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
+    0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D, 0x76DC4190, 0x01DB7106,
+    0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+    0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D,
+    0x91646C97, 0xE6635C01, 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
+    0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950,
+    0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+    0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7,
+    0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
+    0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9, 0x5005713C, 0x270241AA,
+    0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+    0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
+    0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
+    0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683, 0xE3630B12, 0x94643B84,
+    0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+    0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB,
+    0x196C3671, 0x6E6B06E7, 0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
+    0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8, 0xA1D1937E,
+    0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+    0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55,
+    0x316E8EEF, 0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
+    0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28,
+    0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+    0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F,
+    0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
+    0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242,
+    0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+    0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69,
+    0x616BFFD3, 0x166CCF45, 0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
+    0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC,
+    0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+    0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693,
+    0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
+    0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+};
+
+// Scalar reference kernels.
+
+static uint8_t
+sum_scalar (const uint8_t *data, size_t length) {
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; i++) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+static size_t
+find_scalar (const uint8_t *data, size_t length, uint8_t value) {
+    size_t i = 0;
+    while (i < length && data[i] != value) {
+        i++;
+    }
+    return i;
+}
+
+static void
+hex_encode_scalar (char *out, const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        out[2 * i] = hex_digits[data[i] >> 4];
+        out[2 * i + 1] = hex_digits[data[i] & 0xF];
+    }
+}
+
+// Run the CRC register over `length` bytes, without the pre- and
+// post-inversion.
+static uint32_t
+crc32_update (uint32_t crc, const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static uint32_t
+crc32_scalar (uint32_t crc, const uint8_t *data, size_t length) {
+    return ~crc32_update(~crc, data, length);
+}
+
+static void
+realign_scalar (uint8_t *out, const uint8_t *data, size_t length, int shift, uint8_t invert) {
+    for (size_t i = 0; i < length; i++) {
+        uint8_t b = data[i];
+        if (shift) {
+            b = (uint8_t)((b << shift) | (data[i + 1] >> (8 - shift)));
+        }
+        out[i] = b ^ invert;
+    }
+}
+
+static const struct xrec_kernels scalar_kernels = {
+    "scalar", sum_scalar, find_scalar, hex_encode_scalar, crc32_scalar, realign_scalar
+};
+
+#ifdef XREC_KERNELS_X86
+
+// SSE2 kernels, 16 bytes at a time.
+
+__attribute__((target("sse2")))
+static uint8_t
+sum_sse2 (const uint8_t *data, size_t length) {
+    __m128i total = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        total = _mm_add_epi64(total, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, total);
+    return (uint8_t)(lanes[0] + lanes[1] + sum_scalar(data + i, length - i));
+}
+
+__attribute__((target("sse2")))
+static size_t
+find_sse2 (const uint8_t *data, size_t length, uint8_t value) {
+    __m128i match = _mm_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, match));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + find_scalar(data + i, length - i, value);
+}
+
+// Turn each nibble n into '0' + n, plus 7 more for 'A'-'F'.
+__attribute__((target("sse2")))
+static __m128i
+nibbles_to_hex_sse2 (__m128i n) {
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)), _mm_set1_epi8(7));
+    return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), letters);
+}
+
+__attribute__((target("sse2")))
+static void
+hex_encode_sse2 (char *out, const uint8_t *data, size_t length) {
+    __m128i low_nibble = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i high = nibbles_to_hex_sse2(_mm_and_si128(_mm_srli_epi16(v, 4), low_nibble));
+        __m128i low = nibbles_to_hex_sse2(_mm_and_si128(v, low_nibble));
+        _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i *)(out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+    }
+    hex_encode_scalar(out + 2 * i, data + i, length - i);
+}
+
+// There are no byte shifts, so shift 16-bit lanes and mask off the bits that
+// crossed into the neighboring byte. Each block is loaded before it is
+// stored, so realigning in place works.
+__attribute__((target("sse2")))
+static void
+realign_sse2 (uint8_t *out, const uint8_t *data, size_t length, int shift, uint8_t invert) {
+    __m128i left = _mm_cvtsi32_si128(shift);
+    __m128i right = _mm_cvtsi32_si128(8 - shift);
+    __m128i high_mask = _mm_set1_epi8((char)(0xFF << shift));
+    __m128i low_mask = _mm_set1_epi8((char)(0xFF >> (8 - shift)));
+    __m128i flip = _mm_set1_epi8((char)invert);
+    size_t readable = length + (shift != 0);
+    size_t i = 0;
+    for (; i + 17 <= readable; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i next = _mm_loadu_si128((const __m128i *)(data + i + 1));
+        __m128i high = _mm_and_si128(_mm_sll_epi16(v, left), high_mask);
+        __m128i low = _mm_and_si128(_mm_srl_epi16(next, right), low_mask);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_xor_si128(_mm_or_si128(high, low), flip));
+    }
+    realign_scalar(out + i, data + i, length - i, shift, invert);
+}
+
+static const struct xrec_kernels sse2_kernels = {
+    "sse2", sum_sse2, find_sse2, hex_encode_sse2, crc32_scalar, realign_sse2
+};
+
+// CRC-32 by carry-less multiplication, folding 64 bytes at a time and then
+// reducing with Barrett's method, as in Intel's "Fast CRC Computation for
+// Generic Polynomials Using PCLMULQDQ Instruction". Every CPU with AVX2 also
+// has PCLMULQDQ, so the AVX2 and AVX-512 sets use it.
+
+#define CRC32_FOLD_MIN  64
+
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t
+crc32_pclmul (uint32_t crc, const uint8_t *data, size_t length) {
+    crc = ~crc;
+    if (length < CRC32_FOLD_MIN) {
+        return ~crc32_update(crc, data, length);
+    }
+    const __m128i k1k2 = _mm_set_epi64x(0x00000001C6E41596, 0x0000000154442BD4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00000000CCAA009E, 0x00000001751997D0);
+    const __m128i k5 = _mm_set_epi64x(0, 0x0000000163CD6124);
+    const __m128i poly = _mm_set_epi64x(0x00000001F7011641, 0x00000001DB710641);
+    const __m128i mask32 = _mm_set_epi32(0, 0, 0, -1);
+
+    __m128i x1 = _mm_loadu_si128((const __m128i *)data);
+    __m128i x2 = _mm_loadu_si128((const __m128i *)(data + 16));
+    __m128i x3 = _mm_loadu_si128((const __m128i *)(data + 32));
+    __m128i x4 = _mm_loadu_si128((const __m128i *)(data + 48));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    size_t i = 64;
+
+    // Fold four lanes across each further 64 bytes.
+    for (; i + 64 <= length; i += 64) {
+        __m128i h1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        __m128i h2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        __m128i h3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        __m128i h4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x00), h1);
+        x2 = _mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x00), h2);
+        x3 = _mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x00), h3);
+        x4 = _mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x00), h4);
+        x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)(data + i)));
+        x2 = _mm_xor_si128(x2, _mm_loadu_si128((const __m128i *)(data + i + 16)));
+        x3 = _mm_xor_si128(x3, _mm_loadu_si128((const __m128i *)(data + i + 32)));
+        x4 = _mm_xor_si128(x4, _mm_loadu_si128((const __m128i *)(data + i + 48)));
+    }
+
+    // Fold the four lanes into one, then the rest 16 bytes at a time.
+    __m128i lanes[3] = { x2, x3, x4 };
+    for (int lane = 0; lane < 3; lane++) {
+        __m128i high = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), high);
+        x1 = _mm_xor_si128(x1, lanes[lane]);
+    }
+    for (; i + 16 <= length; i += 16) {
+        __m128i high = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00), high);
+        x1 = _mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)(data + i)));
+    }
+
+    // Reduce 128 bits to 64, then to 32.
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(k3k4, x1, 0x01));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5, 0x00), x2);
+    x2 = x1;
+    x1 = _mm_and_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10), mask32);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, poly, 0x00), x2);
+    crc = (uint32_t)_mm_extract_epi32(x1, 1);
+
+    return ~crc32_update(crc, data + i, length - i);
+}
+
+// AVX2 kernels, 32 bytes at a time.
+
+__attribute__((target("avx2")))
+static uint8_t
+sum_avx2 (const uint8_t *data, size_t length) {
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(v, _mm256_setzero_si256()));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, total);
+    return (uint8_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_sse2(data + i, length - i));
+}
+
+__attribute__((target("avx2")))
+static size_t
+find_avx2 (const uint8_t *data, size_t length, uint8_t value) {
+    __m256i match = _mm256_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, match));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + find_sse2(data + i, length - i, value);
+}
+
+__attribute__((target("avx2")))
+static __m256i
+nibbles_to_hex_avx2 (__m256i n) {
+    __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(n, _mm256_set1_epi8(9)), _mm256_set1_epi8(7));
+    return _mm256_add_epi8(_mm256_add_epi8(n, _mm256_set1_epi8('0')), letters);
+}
+
+__attribute__((target("avx2")))
+static void
+hex_encode_avx2 (char *out, const uint8_t *data, size_t length) {
+    __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i high = nibbles_to_hex_avx2(_mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+        __m256i low = nibbles_to_hex_avx2(_mm256_and_si256(v, low_nibble));
+        // Unpacking works within each 128-bit lane, so put the lanes back
+        // in order before storing.
+        __m256i first = _mm256_unpacklo_epi8(high, low);
+        __m256i second = _mm256_unpackhi_epi8(high, low);
+        _mm256_storeu_si256((__m256i *)(out + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    hex_encode_sse2(out + 2 * i, data + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static void
+realign_avx2 (uint8_t *out, const uint8_t *data, size_t length, int shift, uint8_t invert) {
+    __m128i left = _mm_cvtsi32_si128(shift);
+    __m128i right = _mm_cvtsi32_si128(8 - shift);
+    __m256i high_mask = _mm256_set1_epi8((char)(0xFF << shift));
+    __m256i low_mask = _mm256_set1_epi8((char)(0xFF >> (8 - shift)));
+    __m256i flip = _mm256_set1_epi8((char)invert);
+    size_t readable = length + (shift != 0);
+    size_t i = 0;
+    for (; i + 33 <= readable; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i next = _mm256_loadu_si256((const __m256i *)(data + i + 1));
+        __m256i high = _mm256_and_si256(_mm256_sll_epi16(v, left), high_mask);
+        __m256i low = _mm256_and_si256(_mm256_srl_epi16(next, right), low_mask);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_xor_si256(_mm256_or_si256(high, low), flip));
+    }
+    realign_sse2(out + i, data + i, length - i, shift, invert);
+}
+
+static const struct xrec_kernels avx2_kernels = {
+    "avx2", sum_avx2, find_avx2, hex_encode_avx2, crc32_pclmul, realign_avx2
+};
+
+// AVX-512 kernels, 64 bytes at a time. Hex encoding and realignment gain
+// nothing over AVX2 at the lengths they see, so they are shared.
+
+__attribute__((target("avx512f,avx512bw")))
+static uint8_t
+sum_avx512 (const uint8_t *data, size_t length) {
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(data + i));
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(v, _mm512_setzero_si512()));
+    }
+    return (uint8_t)(_mm512_reduce_add_epi64(total) + sum_avx2(data + i, length - i));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t
+find_avx512 (const uint8_t *data, size_t length, uint8_t value) {
+    __m512i match = _mm512_set1_epi8((char)value);
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(data + i));
+        uint64_t mask = _mm512_cmpeq_epi8_mask(v, match);
+        if (mask) {
+            return i + __builtin_ctzll(mask);
+        }
+    }
+    return i + find_avx2(data + i, length - i, value);
+}
+
+static const struct xrec_kernels avx512_kernels = {
+    "avx512", sum_avx512, find_avx512, hex_encode_avx2, crc32_pclmul, realign_avx2
+};
+
+#endif
+
+const struct xrec_kernels *xrec_kernels = &scalar_kernels;
+
+// All kernel sets, best first, with whether this CPU can run them.
+static int
+supported_kernels (const struct xrec_kernels **sets, int *supported) {
+    int count = 0;
+#ifdef XREC_KERNELS_X86
+    __builtin_cpu_init();
+    sets[count] = &avx512_kernels;
+    supported[count++] = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                         __builtin_cpu_supports("pclmul");
+    sets[count] = &avx2_kernels;
+    supported[count++] = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("pclmul");
+    sets[count] = &sse2_kernels;
+    supported[count++] = __builtin_cpu_supports("sse2");
+#endif
+    sets[count] = &scalar_kernels;
+    supported[count++] = 1;
+    return count;
+}
+
+int
+xrec_kernels_init (const char *name) {
+    const struct xrec_kernels *sets[4];
+    int supported[4];
+    int count = supported_kernels(sets, supported);
+    for (int i = 0; i < count; i++) {
+        if (name == NULL ? supported[i] : strcmp(name, sets[i]->name) == 0) {
+            if (!supported[i]) {
+                return 0;
+            }
+            xrec_kernels = sets[i];
+            return 1;
+        }
+    }
+    return 0;
+}
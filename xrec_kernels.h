@@ -0,0 +1,66 @@
+/*
+ * xrec_kernels.h
+ *
+ * The inner loops used by the parser and formatter, with vectorized
+ * versions chosen at runtime to suit the CPU.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * `xrec_kernels` always points at a usable set of kernels; it starts out as
+ * the portable scalar reference versions. Call `xrec_kernels_init` once at
+ * startup, before any parsing begins, to switch to the best set the CPU
+ * supports:
+ *
+ *      if (!xrec_kernels_init(getenv("XREC_KERNEL"))) { ... }
+ *      uint8_t sum = xrec_kernels->sum(data, length);
+ *
+ * Passing a name ("scalar", "sse2", "avx2" or "avx512") forces that set,
+ * e.g. for benchmarking; passing NULL picks the best available. All sets
+ * give identical results. Vectorized sets are only built for x86 with GCC
+ * or Clang; elsewhere only "scalar" exists. The "avx2" and "avx512" sets
+ * also need PCLMULQDQ, which they use for CRC-32.
+ */
+
+#ifndef XREC_KERNELS_H
+#define XREC_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct xrec_kernels {
+    const char *    name;
+
+    // Sum of `length` bytes, modulo 256.
+    uint8_t         (*sum)(const uint8_t *data, size_t length);
+
+    // Offset of the first byte equal to `value`, or `length` if none is.
+    size_t          (*find)(const uint8_t *data, size_t length, uint8_t value);
+
+    // Write `length` bytes as 2 * `length` uppercase hex digits (no NUL).
+    void            (*hex_encode)(char *out, const uint8_t *data, size_t length);
+
+    // CRC-32 (as in zlib and PNG) of `length` bytes, continuing from the
+    // CRC of the data before them; start with 0.
+    uint32_t        (*crc32)(uint32_t crc, const uint8_t *data, size_t length);
+
+    // Write `length` bytes, each byte of `data` shifted left by `shift` bits
+    // (0-7) and filled in from the top of the byte after it, then XORed with
+    // `invert`. Reads `data[length]` too unless `shift` is 0. `out` may be
+    // `data`.
+    void            (*realign)(uint8_t *out, const uint8_t *data, size_t length,
+                               int shift, uint8_t invert);
+};
+
+extern const struct xrec_kernels *xrec_kernels;
+
+// Select the kernels named `name`, or the best supported if `name` is NULL.
+// Returns zero (leaving the selection alone) if the named set is unknown or
+// not supported by this CPU.
+int xrec_kernels_init(const char *name);
+
+#endif
@@ -0,0 +1,394 @@
+/*
+ * xrec_merge.c
+ *
+ * Merge several noisy captures of the same tape into one best-effort
+ * stream of records.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xrec_merge.h"
+
+#define MERGE_CHUNK_SIZE    4096
+#define RAW_RECORD_SIZE     (1 + 2 + 256 + 1)
+#define NO_RECORD           (-1)
+
+struct merge_record {
+    uint8_t raw[RAW_RECORD_SIZE];
+    int     length;
+    int     checksum_error;
+    int     program;        // Termination records before this one in its capture
+    int     occurrence;     // Earlier records at this address in the same program and capture
+    int     next;           // Next record at this address, in any capture
+    int     capture;
+    int     group;          // The first record of its group, or NO_RECORD
+    int     valid;          // For the first record of a group, its first valid copy
+};
+
+struct merge_state {
+    struct merge_record *   records;
+    int                     count;
+    int                     capacity;
+    int                     failed;
+    int                     programs;   // The most termination records in any capture
+};
+
+// A group of copies, to be sorted into the order it is delivered in.
+struct merge_group {
+    uint16_t    address;
+    int         occurrence;
+    int         first;      // Its first record, which breaks any tie
+};
+
+struct merge_context {
+    struct merge_state *    merge;
+    int                     capture;
+    int                     program;
+};
+
+static enum xrec_action
+collect_record (struct xrec_state *xrec,
+                int record_type,
+                uint16_t address,
+                uint8_t *data,
+                int length,
+                int checksum_error) {
+    struct merge_context *context = xrec->context;
+    struct merge_state *merge = context->merge;
+    (void)address;
+    (void)data;
+    (void)length;
+
+    if (record_type == XREC_TERMINATION_16BIT) {
+        context->program++;
+        if (context->program > merge->programs) {
+            merge->programs = context->program;
+        }
+        return XREC_CONTINUE;
+    }
+    if (merge->failed) {
+        return XREC_STOP;
+    }
+    if (record_type != XREC_DATA_16BIT) {
+        return XREC_CONTINUE;
+    }
+    if (merge->count == merge->capacity) {
+        int capacity = merge->capacity ? merge->capacity * 2 : 256;
+        struct merge_record *records = realloc(merge->records, capacity * sizeof(*records));
+        if (records == NULL) {
+            merge->failed = 1;
+            return XREC_STOP;
+        }
+        merge->records = records;
+        merge->capacity = capacity;
+    }
+    struct merge_record *r = &merge->records[merge->count++];
+    memcpy(r->raw, xrec->data, xrec->length);
+    r->length = xrec->length;
+    r->checksum_error = checksum_error;
+    r->capture = context->capture;
+    r->program = context->program;
+    return XREC_CONTINUE;
+}
+
+static uint16_t
+raw_address (const uint8_t *raw) {
+    return (uint16_t)((raw[1] << 8) | raw[2]);
+}
+
+static uint16_t
+record_address (const struct merge_record *r) {
+    return raw_address(r->raw);
+}
+
+static int
+compare_groups (const void *a, const void *b) {
+    const struct merge_group *x = a;
+    const struct merge_group *y = b;
+    if (x->address != y->address) {
+        return (x->address > y->address) - (x->address < y->address);
+    }
+    if (x->occurrence != y->occurrence) {
+        return (x->occurrence > y->occurrence) - (x->occurrence < y->occurrence);
+    }
+    return (x->first > y->first) - (x->first < y->first);
+}
+
+// Build a raw record from the copies in a group by majority vote. Only the
+// copies of the most common length take part; ties go to the earlier copy.
+// Returns the length, and how many copies have it in `agreeing`.
+static int
+vote_record (const struct merge_record *records, const int *group, int copies,
+             uint8_t *raw, int *agreeing) {
+    int length = 0;
+    int best_votes = 0;
+    for (int i = 0; i < copies; i++) {
+        int votes = 0;
+        for (int j = 0; j < copies; j++) {
+            votes += records[group[j]].length == records[group[i]].length;
+        }
+        if (votes > best_votes) {
+            best_votes = votes;
+            length = records[group[i]].length;
+        }
+    }
+    *agreeing = best_votes;
+    for (int b = 0; b < length; b++) {
+        int best_count = 0;
+        for (int i = 0; i < copies; i++) {
+            const struct merge_record *candidate = &records[group[i]];
+            if (candidate->length != length) {
+                continue;
+            }
+            int count = 0;
+            for (int j = 0; j < copies; j++) {
+                const struct merge_record *other = &records[group[j]];
+                count += other->length == length && other->raw[b] == candidate->raw[b];
+            }
+            if (count > best_count) {
+                best_count = count;
+                raw[b] = candidate->raw[b];
+            }
+        }
+    }
+    return length;
+}
+
+static void
+deliver_record (struct xrec_state *out, const uint8_t *raw, int length) {
+    xrec_read_bytes(out, "X1", 2);
+    xrec_read_bytes(out, (const char *)raw, length);
+}
+
+// Mark the addresses that a record writes.
+static void
+cover_record (uint8_t *covered, const struct merge_record *r) {
+    uint16_t address = record_address(r);
+    for (int b = 0; b < r->length - 4; b++) {
+        covered[(uint16_t)(address + b)] = 1;
+    }
+}
+
+// Whether every address from `address` for `length` record bytes is marked.
+static int
+is_covered (const uint8_t *covered, uint16_t address, int length) {
+    for (int b = 0; b < length - 4; b++) {
+        if (!covered[(uint16_t)(address + b)]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int
+xrec_merge_captures (const uint8_t * const *inputs,
+                     const long *lengths,
+                     int capture_count,
+                     struct xrec_state *out,
+                     struct xrec_merge_stats *stats) {
+    struct merge_state merge = { NULL, 0, 0, 0, 0 };
+    struct xrec_state *parsers = calloc(capture_count, sizeof(*parsers));
+    struct merge_context *contexts = calloc(capture_count, sizeof(*contexts));
+    int *heads = malloc(65536 * sizeof(int));
+    int *group = malloc(capture_count * sizeof(int));
+    uint8_t *covered = malloc(65536);
+#ifdef XREC_COMPACT_STATE
+    // The parsers are fed interleaved chunks, so each needs its own.
+    uint8_t *buffers = malloc((size_t)capture_count * XREC_RECORD_SIZE);
+#endif
+    int *order = NULL;
+    int *ends = NULL;
+    struct merge_group *groups = NULL;
+    memset(stats, 0, sizeof(*stats));
+    if (!parsers || !contexts || !heads || !group || !covered) {
+        merge.failed = 1;
+        goto done;
+    }
+#ifdef XREC_COMPACT_STATE
+    if (!buffers) {
+        merge.failed = 1;
+        goto done;
+    }
+#endif
+
+    // Parse all of the captures side by side, a chunk of each in turn, so
+    // that records are collected roughly in tape order across captures.
+    for (int c = 0; c < capture_count; c++) {
+        xrec_begin_read(&parsers[c]);
+#ifdef XREC_COMPACT_STATE
+        parsers[c].data = buffers + (size_t)c * XREC_RECORD_SIZE;
+#endif
+        contexts[c].merge = &merge;
+        contexts[c].capture = c;
+        parsers[c].context = &contexts[c];
+        parsers[c].callback = collect_record;
+    }
+    for (long offset = 0; ; offset += MERGE_CHUNK_SIZE) {
+        int active = 0;
+        for (int c = 0; c < capture_count; c++) {
+            if (offset >= lengths[c]) {
+                continue;
+            }
+            long count = lengths[c] - offset;
+            if (count > MERGE_CHUNK_SIZE) {
+                count = MERGE_CHUNK_SIZE;
+            }
+            xrec_read_bytes(&parsers[c], (const char *)inputs[c] + offset, (int)count);
+            active = 1;
+        }
+        if (!active) {
+            break;
+        }
+    }
+    if (merge.failed) {
+        goto done;
+    }
+
+    // Chain together all records at each address, in order of appearance,
+    // and number each one by how many times its own capture has already
+    // seen that address in the same program. `heads` doubles as the
+    // per-capture counter.
+    for (int c = 0; c < capture_count; c++) {
+        int program = -1;
+        for (int i = 0; i < merge.count; i++) {
+            struct merge_record *r = &merge.records[i];
+            if (r->capture != c) {
+                continue;
+            }
+            if (r->program != program) {
+                memset(heads, 0, 65536 * sizeof(int));
+                program = r->program;
+            }
+            r->occurrence = heads[record_address(r)]++;
+        }
+    }
+    for (int a = 0; a < 65536; a++) {
+        heads[a] = NO_RECORD;
+    }
+    for (int i = merge.count - 1; i >= 0; i--) {
+        uint16_t address = record_address(&merge.records[i]);
+        merge.records[i].next = heads[address];
+        merge.records[i].group = NO_RECORD;
+        heads[address] = i;
+    }
+
+    // Sort the records by program, keeping their order within each one.
+    // Once filled, `ends[p]` is where program p ends in `order`.
+    order = malloc((merge.count ? merge.count : 1) * sizeof(int));
+    ends = calloc(merge.programs + 2, sizeof(int));
+    groups = malloc((merge.count ? merge.count : 1) * sizeof(*groups));
+    if (!order || !ends || !groups) {
+        merge.failed = 1;
+        goto done;
+    }
+    for (int i = 0; i < merge.count; i++) {
+        ends[merge.records[i].program + 1]++;
+    }
+    for (int p = 0; p <= merge.programs; p++) {
+        ends[p + 1] += ends[p];
+    }
+    for (int i = 0; i < merge.count; i++) {
+        order[ends[merge.records[i].program]++] = i;
+    }
+
+    int first = 0;
+    for (int p = 0; p <= merge.programs; first = ends[p++]) {
+        // Gather the copies of each record from every capture, and mark
+        // what the valid copies write.
+        int group_count = 0;
+        memset(covered, 0, 65536);
+        for (int k = first; k < ends[p]; k++) {
+            int i = order[k];
+            struct merge_record *r = &merge.records[i];
+            if (r->group != NO_RECORD) {
+                continue;
+            }
+            r->valid = NO_RECORD;
+            for (int j = i; j != NO_RECORD; j = merge.records[j].next) {
+                struct merge_record *copy = &merge.records[j];
+                if (copy->group == NO_RECORD && copy->program == p &&
+                    copy->occurrence == r->occurrence) {
+                    copy->group = i;
+                    if (r->valid == NO_RECORD && !copy->checksum_error) {
+                        r->valid = j;
+                    }
+                }
+            }
+            if (r->valid != NO_RECORD) {
+                cover_record(covered, &merge.records[r->valid]);
+            }
+            groups[group_count].address = record_address(r);
+            groups[group_count].occurrence = r->occurrence;
+            groups[group_count].first = i;
+            group_count++;
+        }
+
+        // The order of first appearance depends on how the chunks of the
+        // captures interleave, and a record missing from one capture would
+        // come out of place, so deliver each program in address order.
+        // Repeats at one address keep their order on tape.
+        qsort(groups, group_count, sizeof(*groups), compare_groups);
+
+        for (int g = 0; g < group_count; g++) {
+            int i = groups[g].first;
+            struct merge_record *r = &merge.records[i];
+            if (r->valid != NO_RECORD) {
+                stats->records++;
+                stats->from_valid_copy++;
+                deliver_record(out, merge.records[r->valid].raw, merge.records[r->valid].length);
+                continue;
+            }
+
+            int copies = 0;
+            for (int j = i; j != NO_RECORD; j = merge.records[j].next) {
+                if (merge.records[j].group == i) {
+                    group[copies++] = j;
+                }
+            }
+            uint8_t raw[RAW_RECORD_SIZE];
+            int agreeing;
+            int length = vote_record(merge.records, group, copies, raw, &agreeing);
+
+            // A bad address puts a copy in a group of its own, so only vote
+            // on records that most captures agree on, and never over what
+            // the valid copies already provide.
+            if (agreeing * 2 <= capture_count || is_covered(covered, raw_address(raw), length)) {
+                stats->dropped++;
+                continue;
+            }
+            uint8_t sum = 0;
+            for (int b = 0; b < length; b++) {
+                sum += raw[b];
+            }
+            stats->records++;
+            if (sum == 0xFF) {
+                stats->voted_valid++;
+            } else {
+                stats->voted_invalid++;
+            }
+            deliver_record(out, raw, length);
+        }
+        if (p < merge.programs) {
+            xrec_read_bytes(out, "X9", 2);
+        }
+    }
+
+done:
+    free(merge.records);
+    free(parsers);
+    free(contexts);
+    free(heads);
+    free(group);
+    free(covered);
+    free(order);
+    free(ends);
+    free(groups);
+#ifdef XREC_COMPACT_STATE
+    free(buffers);
+#endif
+    return !merge.failed;
+}
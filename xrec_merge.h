@@ -0,0 +1,63 @@
+/*
+ * xrec_merge.h
+ *
+ * Merge several noisy captures of the same tape into one best-effort
+ * stream of records.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * Each capture is parsed by its own xrec_state, with the inputs fed to the
+ * parsers in interleaved chunks. Records are then aligned across captures by
+ * program (counting termination records), address and occurrence, so that
+ * the second record at an address in one program of one capture lines up
+ * with the second at that address in the same program of another. For each
+ * aligned record, the first copy with a valid checksum wins. When every copy
+ * fails, the record is rebuilt by majority vote of each byte, checksum
+ * included, across the copies of the most common length, but only if more
+ * than half of the captures have a copy of that length and the valid records
+ * don't already cover it. Otherwise it is dropped, since a copy whose address
+ * is corrupt lands in a group of its own.
+ *
+ * The merged records are replayed as X-record bytes into a parser supplied by
+ * the caller, so they arrive at its callback exactly as if read from a single
+ * tape, one program at a time, each program in address order (records
+ * repeated at one address keep their order on tape), and with a termination
+ * record after each program that had one:
+ *
+ *      struct xrec_state xrec;
+ *      struct xrec_merge_stats stats;
+ *      xrec_begin_read(&xrec);
+ *      xrec_merge_captures(inputs, lengths, capture_count, &xrec, &stats);
+ *
+ * A voted record that still fails its checksum is delivered with its
+ * checksum error flagged as usual.
+ */
+
+#ifndef XREC_MERGE_H
+#define XREC_MERGE_H
+
+#include <stdint.h>
+#include "xrec.h"
+
+struct xrec_merge_stats {
+    int records;            // Merged data records delivered
+    int from_valid_copy;    // ...taken from a copy with a valid checksum
+    int voted_valid;        // ...rebuilt by vote, and the vote is valid
+    int voted_invalid;      // ...rebuilt by vote, but still failing
+    int dropped;            // Records that failed in every copy and were not rebuilt
+};
+
+// Parse `capture_count` inputs and deliver the merged records to `out`.
+// Returns zero if memory could not be allocated.
+int xrec_merge_captures(const uint8_t * const *inputs,
+                        const long *lengths,
+                        int capture_count,
+                        struct xrec_state *out,
+                        struct xrec_merge_stats *stats);
+
+#endif
@@ -0,0 +1,387 @@
+/*
+ * xrec_reader.c
+ *
+ * Read-ahead of an input file, with io_uring on Linux or on a background
+ * thread elsewhere.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <stdlib.h>
+#include "xrec_reader.h"
+
+#if defined(__linux__) && !defined(XREC_NO_IO_URING)
+#include <errno.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __NR_io_uring_setup
+#define XREC_READER_URING 1
+#endif
+#endif
+
+#ifdef XREC_READER_URING
+
+// A submission and completion queue shared with the kernel, with one read
+// for each chunk buffer in flight at a time.
+struct xrec_uring {
+    int                     fd;
+    int                     file;       // Descriptor of the input
+    off_t                   base;       // Input offset of the first chunk
+    void *                  sq_ring;
+    size_t                  sq_ring_size;
+    void *                  cq_ring;
+    size_t                  cq_ring_size;
+    struct io_uring_sqe *   sqes;
+    size_t                  sqes_size;
+    unsigned *              sq_tail;
+    unsigned *              sq_mask;
+    unsigned *              sq_array;
+    unsigned *              cq_head;
+    unsigned *              cq_tail;
+    unsigned *              cq_mask;
+    struct io_uring_cqe *   cqes;
+    struct iovec            iov[XREC_READER_CHUNKS];
+    int                     complete[XREC_READER_CHUNKS];
+    int                     in_flight;  // Reads submitted and not yet completed
+    int                     at_end;     // A chunk came up short, so no more are read
+};
+
+static int
+uring_enter (int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void
+uring_close (struct xrec_uring *uring) {
+    if (uring->sqes != MAP_FAILED) {
+        munmap(uring->sqes, uring->sqes_size);
+    }
+    if (uring->cq_ring != MAP_FAILED && uring->cq_ring != uring->sq_ring) {
+        munmap(uring->cq_ring, uring->cq_ring_size);
+    }
+    if (uring->sq_ring != MAP_FAILED) {
+        munmap(uring->sq_ring, uring->sq_ring_size);
+    }
+    close(uring->fd);
+    free(uring);
+}
+
+// Set up a ring for reading `file`, or return NULL to read it on a thread
+// instead: if it isn't a regular file, or io_uring is missing or disabled.
+static struct xrec_uring *
+uring_open (FILE *file) {
+    struct stat info;
+    if (fstat(fileno(file), &info) != 0 || !S_ISREG(info.st_mode)) {
+        return NULL;
+    }
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, XREC_READER_CHUNKS, &params);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct xrec_uring *uring = calloc(1, sizeof(*uring));
+    if (uring == NULL) {
+        close(fd);
+        return NULL;
+    }
+    uring->fd = fd;
+    uring->file = fileno(file);
+    uring->base = ftello(file);
+
+    // Older kernels map the two rings separately.
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && uring->cq_ring_size > uring->sq_ring_size) {
+        uring->sq_ring_size = uring->cq_ring_size;
+    }
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    uring->cq_ring = single ? uring->sq_ring :
+                     mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (uring->base < 0 || uring->sq_ring == MAP_FAILED ||
+        uring->cq_ring == MAP_FAILED || uring->sqes == MAP_FAILED) {
+        uring_close(uring);
+        return NULL;
+    }
+    uint8_t *sq = uring->sq_ring;
+    uint8_t *cq = uring->cq_ring;
+    uring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    uring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    uring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    uring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    uring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    uring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return uring;
+}
+
+// Read the rest of chunk number `chunk` into its buffer, from however much
+// of it has arrived so far. Returns zero if the read couldn't be submitted.
+static int
+uring_read (struct xrec_reader *reader, size_t chunk) {
+    struct xrec_uring *uring = reader->uring;
+    size_t slot = chunk % XREC_READER_CHUNKS;
+    size_t have = reader->lengths[slot];
+    uring->iov[slot].iov_base = reader->chunks[slot] + have;
+    uring->iov[slot].iov_len = XREC_READER_CHUNK_SIZE - have;
+    uring->complete[slot] = 0;
+
+    unsigned tail = *uring->sq_tail;
+    unsigned index = tail & *uring->sq_mask;
+    struct io_uring_sqe *sqe = &uring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = uring->file;
+    sqe->addr = (uint64_t)(uintptr_t)&uring->iov[slot];
+    sqe->len = 1;
+    sqe->off = (uint64_t)uring->base + (uint64_t)chunk * XREC_READER_CHUNK_SIZE + have;
+    sqe->user_data = chunk;
+    uring->sq_array[index] = index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    int submitted;
+    while ((submitted = uring_enter(uring->fd, 1, 0, 0)) < 0 && errno == EINTR) {
+    }
+    if (submitted != 1) {
+        // Take the entry back so the kernel never sees it.
+        __atomic_store_n(uring->sq_tail, tail, __ATOMIC_RELEASE);
+        return 0;
+    }
+    uring->in_flight++;
+    return 1;
+}
+
+// Wait for at least one read to complete, and account for all that have. A
+// short read is continued from where it stopped, until the chunk is full or
+// a read returns nothing at the end of the file. Returns zero if it couldn't
+// wait.
+static int
+uring_wait (struct xrec_reader *reader) {
+    struct xrec_uring *uring = reader->uring;
+    if (uring_enter(uring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+        return 0;
+    }
+    unsigned head = *uring->cq_head;
+    unsigned tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &uring->cqes[head & *uring->cq_mask];
+        size_t chunk = (size_t)cqe->user_data;
+        size_t slot = chunk % XREC_READER_CHUNKS;
+        int result = cqe->res;
+        uring->in_flight--;
+        if (result == -EINTR || result == -EAGAIN) {
+            result = 0;
+        } else if (result < 0) {
+            reader->error = 1;
+            uring->at_end = 1;
+            uring->complete[slot] = 1;
+            continue;
+        } else if (result == 0) {
+            uring->complete[slot] = 1;
+            uring->at_end = 1;
+            continue;
+        }
+        reader->lengths[slot] += (size_t)result;
+        if (reader->lengths[slot] == XREC_READER_CHUNK_SIZE || reader->done ||
+            !uring_read(reader, chunk)) {
+            uring->complete[slot] = 1;
+            if (reader->lengths[slot] < XREC_READER_CHUNK_SIZE && !reader->done) {
+                reader->error = 1;
+                uring->at_end = 1;
+            }
+        }
+    }
+    __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+    return 1;
+}
+
+#endif
+
+static void *
+read_ahead (void *context) {
+    struct xrec_reader *reader = context;
+
+    pthread_mutex_lock(&reader->lock);
+    while (!reader->done) {
+        // Wait for a free chunk.
+        while (reader->filled - reader->consumed == XREC_READER_CHUNKS && !reader->done) {
+            pthread_cond_wait(&reader->changed, &reader->lock);
+        }
+        if (reader->done) {
+            break;
+        }
+        size_t slot = reader->filled % XREC_READER_CHUNKS;
+
+        // Read without holding the lock; the consumer never touches a chunk
+        // that hasn't been filled.
+        pthread_mutex_unlock(&reader->lock);
+        size_t length = fread(reader->chunks[slot], 1, XREC_READER_CHUNK_SIZE, reader->file);
+        int error = ferror(reader->file);
+        pthread_mutex_lock(&reader->lock);
+
+        reader->lengths[slot] = length;
+        if (length > 0) {
+            reader->filled++;
+        }
+        if (length < XREC_READER_CHUNK_SIZE) {
+            reader->error = error;
+            reader->done = 1;
+        }
+        pthread_cond_broadcast(&reader->changed);
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return NULL;
+}
+
+int
+xrec_reader_start (struct xrec_reader *reader, FILE *file) {
+    reader->file = file;
+    reader->uring = NULL;
+    reader->filled = 0;
+    reader->consumed = 0;
+    reader->done = 0;
+    reader->error = 0;
+    int success = 1;
+    for (int i = 0; i < XREC_READER_CHUNKS; i++) {
+        reader->chunks[i] = malloc(XREC_READER_CHUNK_SIZE);
+        reader->lengths[i] = 0;
+        success = success && reader->chunks[i] != NULL;
+    }
+#ifdef XREC_READER_URING
+    // Put a read of every chunk in flight at once.
+    if (success && (reader->uring = uring_open(file)) != NULL) {
+        while (reader->filled < XREC_READER_CHUNKS && uring_read(reader, reader->filled)) {
+            reader->filled++;
+        }
+        if (reader->filled == 0) {
+            uring_close(reader->uring);
+            reader->uring = NULL;
+        } else {
+            return 1;
+        }
+    }
+#endif
+    if (success) {
+        pthread_mutex_init(&reader->lock, NULL);
+        pthread_cond_init(&reader->changed, NULL);
+        if (pthread_create(&reader->thread, NULL, read_ahead, reader) != 0) {
+            pthread_mutex_destroy(&reader->lock);
+            pthread_cond_destroy(&reader->changed);
+            success = 0;
+        }
+    }
+    if (!success) {
+        for (int i = 0; i < XREC_READER_CHUNKS; i++) {
+            free(reader->chunks[i]);
+        }
+    }
+    return success;
+}
+
+const uint8_t *
+xrec_reader_next (struct xrec_reader *reader, size_t *length) {
+    const uint8_t *chunk = NULL;
+#ifdef XREC_READER_URING
+    if (reader->uring != NULL) {
+        // Chunks past the end of the file come back empty.
+        size_t slot = reader->consumed % XREC_READER_CHUNKS;
+        if (reader->consumed == reader->filled) {
+            return NULL;
+        }
+        while (!reader->uring->complete[slot] && !reader->error) {
+            if (!uring_wait(reader)) {
+                reader->error = 1;
+            }
+        }
+        if (reader->error || reader->lengths[slot] == 0) {
+            return NULL;
+        }
+        *length = reader->lengths[slot];
+        return reader->chunks[slot];
+    }
+#endif
+    pthread_mutex_lock(&reader->lock);
+    while (reader->filled == reader->consumed && !reader->done) {
+        pthread_cond_wait(&reader->changed, &reader->lock);
+    }
+    if (reader->filled != reader->consumed) {
+        size_t slot = reader->consumed % XREC_READER_CHUNKS;
+        chunk = reader->chunks[slot];
+        *length = reader->lengths[slot];
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return chunk;
+}
+
+void
+xrec_reader_release (struct xrec_reader *reader) {
+#ifdef XREC_READER_URING
+    if (reader->uring != NULL) {
+        // Reuse the buffer for the next chunk not yet asked for.
+        size_t slot = reader->consumed % XREC_READER_CHUNKS;
+        reader->consumed++;
+        reader->lengths[slot] = 0;
+        if (!reader->uring->at_end && !reader->error) {
+            if (uring_read(reader, reader->filled)) {
+                reader->filled++;
+            } else {
+                reader->error = 1;
+            }
+        }
+        return;
+    }
+#endif
+    pthread_mutex_lock(&reader->lock);
+    reader->consumed++;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+}
+
+int
+xrec_reader_finish (struct xrec_reader *reader) {
+#ifdef XREC_READER_URING
+    if (reader->uring != NULL) {
+        // The kernel may still be writing into the buffers, so wait for
+        // every read in flight before freeing them.
+        reader->done = 1;
+        while (reader->uring->in_flight > 0) {
+            if (!uring_wait(reader)) {
+                // Leak the buffers rather than free them under the kernel.
+                uring_close(reader->uring);
+                return 0;
+            }
+        }
+        uring_close(reader->uring);
+        for (int i = 0; i < XREC_READER_CHUNKS; i++) {
+            free(reader->chunks[i]);
+        }
+        return !reader->error;
+    }
+#endif
+    // Stop the reader early if the consumer gave up before end of file.
+    pthread_mutex_lock(&reader->lock);
+    reader->done = 1;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+    pthread_join(reader->thread, NULL);
+
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->changed);
+    for (int i = 0; i < XREC_READER_CHUNKS; i++) {
+        free(reader->chunks[i]);
+    }
+    return !reader->error;
+}
@@ -0,0 +1,77 @@
+/*
+ * xrec_reader.h
+ *
+ * Read-ahead of an input file, so that the next chunks are already in
+ * memory, or on their way, while the caller parses earlier ones.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ *      struct xrec_reader reader;
+ *      if (xrec_reader_start(&reader, file)) {
+ *          const uint8_t *chunk;
+ *          size_t length;
+ *          while ((chunk = xrec_reader_next(&reader, &length)) != NULL) {
+ *              xrec_read_bytes(&xrec, (const char *)chunk, (int)length);
+ *              xrec_reader_release(&reader);
+ *          }
+ *          ok = xrec_reader_finish(&reader);
+ *      }
+ *
+ * Up to XREC_READER_CHUNKS chunks are read ahead of the consumer, which sees
+ * them in file order. On Linux, a regular file is read with io_uring: a read
+ * of every free chunk is in flight at once, each chunk is handed over as soon
+ * as its own read completes, and releasing it puts the read of the next
+ * chunk in flight. Elsewhere, or for a pipe, or if io_uring is unavailable
+ * (e.g. disabled by the system), a background thread reads one chunk at a
+ * time with `fread` instead. Compile with -DXREC_NO_IO_URING to always use
+ * the thread. Either way, memory use is bounded by the chunk buffers no
+ * matter how large the file is.
+ */
+
+#ifndef XREC_READER_H
+#define XREC_READER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define XREC_READER_CHUNKS      4
+#define XREC_READER_CHUNK_SIZE  (1024 * 1024)
+
+struct xrec_uring;
+
+struct xrec_reader {
+    FILE *              file;
+    struct xrec_uring * uring;    // The io_uring backend, or NULL for the thread
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      changed;
+    uint8_t *           chunks[XREC_READER_CHUNKS];
+    size_t              lengths[XREC_READER_CHUNKS];
+    size_t              filled;   // Chunks filled by the thread, or asked for with io_uring
+    size_t              consumed; // Chunks released by the consumer
+    int                 done;     // Nonzero once the reader has hit end of file or is finishing
+    int                 error;    // Nonzero if a read failed
+};
+
+// Start reading `file` ahead. Returns zero if the buffers or thread could
+// not be created.
+int xrec_reader_start(struct xrec_reader *reader, FILE *file);
+
+// Wait for the next chunk. Returns NULL once the whole file has been seen.
+const uint8_t *xrec_reader_next(struct xrec_reader *reader, size_t *length);
+
+// Hand the chunk returned by the last `xrec_reader_next` back for reuse.
+void xrec_reader_release(struct xrec_reader *reader);
+
+// Wait for any reads still under way and free the buffers. Returns zero if
+// a read failed. The file is not closed.
+int xrec_reader_finish(struct xrec_reader *reader);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * xrec_repair.c
+ *
+ * Candidate corrections for X1 records that fail their checksum.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include "xrec_repair.h"
+
+#define RAW_ADDRESS_HIGH    1
+#define RAW_ADDRESS_LOW     2
+#define RAW_DATA            3
+
+#define SCORE_SINGLE_FLIP   4
+#define SCORE_CONTINUITY    16
+#define SCORE_OPCODE        2
+
+// Bitmap of the 197 opcodes defined by the 6800. Bit n of word n/32 is set
+// for valid opcode n.
+static const uint32_t valid_opcodes[8] = {
+    0x0AC3FFC2, 0xCAFFFFFD, 0xB7D9B7D9, 0xF7D9F7D9,
+    0xDFF77F77, 0xFFF7FFF7, 0xCFF74F77, 0xCFF7CFF7
+};
+
+static int
+is_valid_opcode (uint8_t b) {
+    return (valid_opcodes[b >> 5] >> (b & 31)) & 1;
+}
+
+static void
+insert_candidate (struct xrec_repair_candidate *candidates, int *stored,
+                  int max_candidates, const struct xrec_repair_candidate *c) {
+    int i = *stored;
+    if (i == max_candidates) {
+        if (i == 0 || candidates[i - 1].score >= c->score) {
+            return;
+        }
+        --i;
+    } else {
+        ++*stored;
+    }
+    // Keep the list sorted best-first; equal scores keep discovery order.
+    while (i > 0 && candidates[i - 1].score < c->score) {
+        candidates[i] = candidates[i - 1];
+        --i;
+    }
+    candidates[i] = *c;
+}
+
+// Score a candidate, and note whether it restores the expected address.
+static int
+score_change (const uint8_t *raw, int length, int expected_address,
+              struct xrec_repair_candidate *c) {
+    int score = c->changes == 1 ? SCORE_SINGLE_FLIP : 0;
+    uint8_t address_high = raw[RAW_ADDRESS_HIGH];
+    uint8_t address_low = raw[RAW_ADDRESS_LOW];
+    int touches_address = 0;
+
+    for (int i = 0; i < c->changes; i++) {
+        int offset = c->offset[i];
+        if (offset == RAW_ADDRESS_HIGH) {
+            address_high = c->value[i];
+            touches_address = 1;
+        } else if (offset == RAW_ADDRESS_LOW) {
+            address_low = c->value[i];
+            touches_address = 1;
+        } else if (offset < length - 1) {
+            int was_valid = is_valid_opcode(raw[offset]);
+            int now_valid = is_valid_opcode(c->value[i]);
+            score += (now_valid - was_valid) * SCORE_OPCODE;
+        }
+    }
+
+    c->continues = 0;
+    if (touches_address && expected_address >= 0) {
+        int original = (raw[RAW_ADDRESS_HIGH] << 8) | raw[RAW_ADDRESS_LOW];
+        int corrected = (address_high << 8) | address_low;
+        if (corrected == expected_address) {
+            c->continues = 1;
+            score += SCORE_CONTINUITY;
+        } else if (original == expected_address) {
+            score -= SCORE_CONTINUITY;
+        }
+    }
+    return score;
+}
+
+int
+xrec_repair_record (const uint8_t *raw, int length, int expected_address,
+                    struct xrec_repair_candidate *candidates,
+                    int max_candidates) {
+    // The record is valid when all of its bytes, checksum included, sum to
+    // 0xFF. `needed` is the change to that sum that a correction must make.
+    uint8_t sum = 0;
+    for (int i = 0; i < length; i++) {
+        sum += raw[i];
+    }
+    uint8_t needed = (uint8_t)(0xFF - sum);
+    if (needed == 0) {
+        return 0;
+    }
+
+    int found = 0;
+    int stored = 0;
+    struct xrec_repair_candidate c;
+    for (int j = RAW_ADDRESS_HIGH; j < length; j++) {
+        for (int k = 0; k < 8; k++) {
+            uint8_t first = raw[j] ^ (uint8_t)(1 << k);
+            uint8_t first_delta = (uint8_t)(first - raw[j]);
+
+            if (first_delta == needed) {
+                c.changes = 1;
+                c.offset[0] = j;
+                c.value[0] = first;
+                c.score = score_change(raw, length, expected_address, &c);
+                insert_candidate(candidates, &stored, max_candidates, &c);
+                found++;
+            }
+            if (j + 1 == length) {
+                continue;
+            }
+            for (int m = 0; m < 8; m++) {
+                uint8_t second = raw[j + 1] ^ (uint8_t)(1 << m);
+                if ((uint8_t)(first_delta + second - raw[j + 1]) == needed) {
+                    c.changes = 2;
+                    c.offset[0] = j;
+                    c.value[0] = first;
+                    c.offset[1] = j + 1;
+                    c.value[1] = second;
+                    c.score = score_change(raw, length, expected_address, &c);
+                    insert_candidate(candidates, &stored, max_candidates, &c);
+                    found++;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+void
+xrec_repair_apply (uint8_t *raw, const struct xrec_repair_candidate *candidate) {
+    for (int i = 0; i < candidate->changes; i++) {
+        raw[candidate->offset[i]] = candidate->value[i];
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ * xrec_repair.h
+ *
+ * Candidate corrections for X1 records that fail their checksum.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * From within the `xrec_data_read` callback, when `checksum_error` is set,
+ * the raw record (count, address, data and checksum) is still available in
+ * the xrec structure and can be handed to the repair search:
+ *
+ *      struct xrec_repair_candidate candidates[8];
+ *      int found = xrec_repair_record(xrec->data, xrec->length,
+ *                                     expected_address, candidates, 8);
+ *
+ * Every single-bit flip, and every pair of flipped bits in two adjacent
+ * bytes (a short burst), that restores the one's-complement checksum is a
+ * candidate. The count byte is never altered because a change there would
+ * have changed how the record was framed. Candidates are ranked by
+ * plausibility: fewer flips, an address that continues on from the previous
+ * record (`expected_address`, or -1 if unknown), and data bytes that become
+ * rather than stop being valid 6800 opcodes all score higher.
+ *
+ * Note that a checksum can only detect, not locate, an error, so there are
+ * usually many candidates. Treat the ranking as advice. The opcode
+ * heuristic can't tell a damaged data byte from a damaged checksum, so only
+ * trust a correction that is the sole candidate, or the only one that
+ * restores the expected address (such candidates always rank first).
+ */
+
+#ifndef XREC_REPAIR_H
+#define XREC_REPAIR_H
+
+#include <stdint.h>
+
+struct xrec_repair_candidate {
+    int     changes;    // Number of bytes altered (1 or 2)
+    int     offset[2];  // Offsets of the altered bytes in the raw record
+    uint8_t value[2];   // Corrected values of those bytes
+    int     score;      // Higher is more plausible
+    int     continues;  // Nonzero if it restores the expected address
+};
+
+// Search for corrections to the `length` byte raw record in `raw`. Up to
+// `max_candidates` of the best candidates are stored in `candidates`, best
+// first. Returns the total number of candidates found, which may be more
+// than were stored. Returns 0 if the record's checksum is already valid.
+int xrec_repair_record(const uint8_t *raw, int length, int expected_address,
+                       struct xrec_repair_candidate *candidates,
+                       int max_candidates);
+
+// Apply a candidate to a raw record in place.
+void xrec_repair_apply(uint8_t *raw, const struct xrec_repair_candidate *candidate);
+
+#endif
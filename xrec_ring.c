@@ -0,0 +1,49 @@
+/*
+ * xrec_ring.c
+ *
+ * A lock-free single-producer/single-consumer ring of parsed records.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <sched.h>
+#include "xrec_ring.h"
+
+void
+xrec_ring_init (struct xrec_ring *ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+struct xrec_record *
+xrec_ring_reserve (struct xrec_ring *ring) {
+    // Only this thread writes head, so it can be read relaxed.
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == XREC_RING_SLOTS) {
+        sched_yield();
+    }
+    return &ring->records[head & (XREC_RING_SLOTS - 1)];
+}
+
+void
+xrec_ring_publish (struct xrec_ring *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+const struct xrec_record *
+xrec_ring_peek (struct xrec_ring *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (atomic_load_explicit(&ring->head, memory_order_acquire) == tail) {
+        sched_yield();
+    }
+    return &ring->records[tail & (XREC_RING_SLOTS - 1)];
+}
+
+void
+xrec_ring_release (struct xrec_ring *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
@@ -0,0 +1,69 @@
+/*
+ * xrec_ring.h
+ *
+ * A lock-free single-producer/single-consumer ring of parsed records, for
+ * handing records from a parsing thread to an output thread.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * The producer fills in a slot and publishes it:
+ *
+ *      struct xrec_record *r = xrec_ring_reserve(ring);   // waits if full
+ *      r->type = record_type; ...
+ *      xrec_ring_publish(ring);
+ *
+ * and the consumer takes slots in the same order:
+ *
+ *      const struct xrec_record *r = xrec_ring_peek(ring); // waits if empty
+ *      ...
+ *      xrec_ring_release(ring);
+ *
+ * Exactly one thread may produce and one thread may consume. The only
+ * synchronization is an acquire/release pair on each of the head and tail
+ * counters, which live on separate cache lines. A producer that finds the
+ * ring full (or a consumer that finds it empty) yields its time slice and
+ * tries again.
+ */
+
+#ifndef XREC_RING_H
+#define XREC_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define XREC_RING_SLOTS     256     // Must be a power of two
+#define XREC_CACHE_LINE     64
+
+// A record as delivered to the `xrec_data_read` callback. A type of zero is
+// free for the caller to use, e.g. to mark the end of the stream.
+struct xrec_record {
+    int         type;
+    uint16_t    address;
+    int         length;
+    int         checksum_error;
+    uint8_t     data[256];
+};
+
+struct xrec_ring {
+    _Alignas(XREC_CACHE_LINE) atomic_size_t head;   // Slots published by the producer
+    _Alignas(XREC_CACHE_LINE) atomic_size_t tail;   // Slots released by the consumer
+    _Alignas(XREC_CACHE_LINE) struct xrec_record records[XREC_RING_SLOTS];
+};
+
+void xrec_ring_init(struct xrec_ring *ring);
+
+// Producer side.
+struct xrec_record *xrec_ring_reserve(struct xrec_ring *ring);
+void xrec_ring_publish(struct xrec_ring *ring);
+
+// Consumer side.
+const struct xrec_record *xrec_ring_peek(struct xrec_ring *ring);
+void xrec_ring_release(struct xrec_ring *ring);
+
+#endif
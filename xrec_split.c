@@ -0,0 +1,107 @@
+/*
+ * xrec_split.c
+ *
+ * Find the separate programs in a multi-program capture.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <stdlib.h>
+#include "xrec_split.h"
+
+#define SPLIT_CHUNK_SIZE    0x40000000
+
+struct split_state {
+    struct xrec_program *   programs;
+    long                    count;
+    long                    capacity;
+    long                    min_gap;
+    int                     open;       // Nonzero while programs[count] is being built
+    int                     failed;
+};
+
+// Finish the program being built, keeping it only if it has any data.
+static void
+close_program (struct split_state *split) {
+    if (split->open && split->programs[split->count].records > 0) {
+        split->count++;
+    }
+    split->open = 0;
+}
+
+static enum xrec_action
+find_boundary (struct xrec_state *xrec,
+               int record_type,
+               uint16_t address,
+               uint8_t *data,
+               int length,
+               int checksum_error) {
+    struct split_state *split = xrec->context;
+    long offset = (long)xrec->record_offset;
+    (void)address;
+    (void)data;
+    (void)length;
+    (void)checksum_error;
+
+    if (split->open && offset - split->programs[split->count].end >= split->min_gap) {
+        close_program(split);
+    }
+    if (!split->open) {
+        if (split->count == split->capacity) {
+            long capacity = split->capacity ? split->capacity * 2 : 16;
+            struct xrec_program *programs = realloc(split->programs, capacity * sizeof(*programs));
+            if (programs == NULL) {
+                split->failed = 1;
+                return XREC_STOP;
+            }
+            split->programs = programs;
+            split->capacity = capacity;
+        }
+        struct xrec_program *program = &split->programs[split->count];
+        program->start = offset;
+        program->records = 0;
+        program->terminated = 0;
+        split->open = 1;
+    }
+
+    // The "X", the type and the raw record.
+    struct xrec_program *program = &split->programs[split->count];
+    program->end = offset + 2 + xrec->length;
+    if (record_type == XREC_DATA_16BIT) {
+        program->records++;
+    } else if (record_type == XREC_TERMINATION_16BIT) {
+        program->terminated = 1;
+        close_program(split);
+    }
+    return XREC_CONTINUE;
+}
+
+long
+xrec_split_programs (const uint8_t *data, long length, long min_gap,
+                     struct xrec_program **programs) {
+    struct split_state split = { NULL, 0, 0, min_gap, 0, 0 };
+    struct xrec_state xrec;
+    xrec_begin_read(&xrec);
+#ifdef XREC_COMPACT_STATE
+    uint8_t record[XREC_RECORD_SIZE];
+    xrec.data = record;
+#endif
+    xrec.context = &split;
+    xrec.callback = find_boundary;
+    for (long offset = 0; !split.failed && offset < length; offset += SPLIT_CHUNK_SIZE) {
+        long count = length - offset;
+        if (count > SPLIT_CHUNK_SIZE) {
+            count = SPLIT_CHUNK_SIZE;
+        }
+        xrec_read_bytes(&xrec, (const char *)data + offset, (int)count);
+    }
+    close_program(&split);
+    if (split.failed) {
+        free(split.programs);
+        return -1;
+    }
+    *programs = split.programs;
+    return split.count;
+}
@@ -0,0 +1,49 @@
+/*
+ * xrec_split.h
+ *
+ * Find the separate programs in a capture that holds more than one, so
+ * that each can be converted on its own.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ *      struct xrec_program *programs;
+ *      long count = xrec_split_programs(data, length, XREC_SPLIT_DEFAULT_GAP, &programs);
+ *      for (long i = 0; i < count; i++) {
+ *          // Feed data[programs[i].start] up to data[programs[i].end] to a parser
+ *      }
+ *      free(programs);
+ *
+ * A program ends at its termination (X9) record. Because a termination
+ * record can be lost to a dropout, a program also ends wherever there is a
+ * gap of at least `min_gap` bytes between records, which is what the leader
+ * between two programs on a tape looks like. Programs without any data
+ * records (e.g. a stray X9) are left out.
+ */
+
+#ifndef XREC_SPLIT_H
+#define XREC_SPLIT_H
+
+#include <stdint.h>
+#include "xrec.h"
+
+#define XREC_SPLIT_DEFAULT_GAP  256
+
+struct xrec_program {
+    long    start;          // Input offset of the program's first record
+    long    end;            // Input offset just past its last record
+    long    records;        // Data records, including any that fail their checksum
+    int     terminated;     // Nonzero if the program ended with an X9
+};
+
+// Find the programs in `data`. Stores a newly allocated array of them in
+// `*programs` (which the caller frees) and returns how many there are, or
+// returns -1 if there isn't enough memory.
+long xrec_split_programs(const uint8_t *data, long length, long min_gap,
+                         struct xrec_program **programs);
+
+#endif
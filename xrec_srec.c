@@ -0,0 +1,167 @@
+/*
+ * xrec_srec.c
+ *
+ * Formatting of X-records as Motorola S-records.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <string.h>
+#include "xrec_kernels.h"
+#include "xrec_srec.h"
+
+#define CONVERT_CHUNK_SIZE  0x40000000
+
+static const char termination[] = "S9030000FC\n";
+
+// Where `xrec_to_srec` puts its text.
+struct buffer_sink {
+    char *  out;
+    size_t  capacity;
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+// A single byte isn't worth a call through the kernel table.
+static char *
+put_hex (char *p, uint8_t value) {
+    p[0] = hex_digits[value >> 4];
+    p[1] = hex_digits[value & 0xF];
+    return p + 2;
+}
+
+// Pass finished text to the sink and count it.
+static void
+emit (struct srec_state *srec, const char *text, size_t length) {
+    if (srec->sink != NULL) {
+        srec->sink(srec, text, length);
+    }
+    srec->size += length;
+}
+
+void
+srec_begin_write (struct srec_state *srec, srec_sink_t sink, void *context) {
+    srec->sink = sink;
+    srec->context = context;
+    srec->address = 0;
+    srec->length = 0;
+    srec->last_record_type = 0;
+    srec->size = 0;
+}
+
+void
+srec_flush (struct srec_state *srec) {
+    if (srec->length == 0) {
+        return;
+    }
+    size_t line_length = 2 + 2 + 4 + 2 * srec->length + 2 + 1;
+    if (srec->sink == NULL) {
+        srec->size += line_length;
+    } else {
+        // Build the whole line and write it at once.
+        char line[SREC_MAX_LINE_LENGTH];
+        char *p = line;
+        uint8_t output_count = 2 + srec->length + 1;
+        *p++ = 'S';
+        *p++ = '1';
+        p = put_hex(p, output_count);
+        p = put_hex(p, srec->address >> 8);
+        p = put_hex(p, srec->address & 0xFF);
+        uint8_t sum = output_count + (srec->address >> 8) + (srec->address & 0xFF);
+        xrec_kernels->hex_encode(p, srec->data, srec->length);
+        p += 2 * srec->length;
+        sum += xrec_kernels->sum(srec->data, srec->length);
+        p = put_hex(p, ~sum & 0xFF);
+        *p++ = '\n';
+        emit(srec, line, line_length);
+    }
+
+    // Update address to point to next implied address and reset length.
+    srec->address += srec->length;
+    srec->length = 0;
+}
+
+void
+srec_write_record (struct srec_state *srec, int record_type, uint16_t address,
+                   const uint8_t *data, int length) {
+    if (record_type == XREC_DATA_16BIT) {
+        // If the address of the inbound record is not aligned with the presumed
+        // next address of the current outbound record, flush it.
+        if (address != srec->address + srec->length) {
+            srec_flush(srec);
+            srec->address = address;
+        }
+        // Pour the inbound data into the outbound vessel, a line at a time.
+        while (length > 0) {
+            int count = SREC_MAX_DATA_BYTES_PER_LINE - srec->length;
+            if (count > length) {
+                count = length;
+            }
+            memcpy(srec->data + srec->length, data, count);
+            srec->length += count;
+            data += count;
+            length -= count;
+            if (srec->length == SREC_MAX_DATA_BYTES_PER_LINE) {
+                srec_flush(srec);
+            }
+        }
+    } else if (record_type == XREC_TERMINATION_16BIT) {
+        // Don't leave a partial line behind.
+        srec_flush(srec);
+        emit(srec, termination, sizeof(termination) - 1);
+    }
+    srec->last_record_type = record_type;
+}
+
+// Copy text into the buffer if it fits entirely.
+static void
+write_buffer (struct srec_state *srec, const char *text, size_t length) {
+    struct buffer_sink *buffer = srec->context;
+    if (srec->size + length <= buffer->capacity) {
+        memcpy(buffer->out + srec->size, text, length);
+    }
+}
+
+static enum xrec_action
+convert_record (struct xrec_state *xrec,
+                int record_type,
+                uint16_t address,
+                uint8_t *data,
+                int length,
+                int checksum_error) {
+    (void)checksum_error;
+    srec_write_record(xrec->context, record_type, address, data, length);
+    return XREC_CONTINUE;
+}
+
+size_t
+xrec_to_srec (const char *input, size_t length, char *out, size_t capacity,
+              enum xrec_error *error) {
+    struct buffer_sink buffer = { out, capacity };
+    struct srec_state srec;
+    srec_begin_write(&srec, out != NULL ? write_buffer : NULL, &buffer);
+
+    struct xrec_state xrec;
+    xrec_begin_read(&xrec);
+#ifdef XREC_COMPACT_STATE
+    uint8_t record[XREC_RECORD_SIZE];
+    xrec.data = record;
+#endif
+    xrec.context = &srec;
+    xrec.callback = convert_record;
+    for (size_t offset = 0; offset < length; offset += CONVERT_CHUNK_SIZE) {
+        size_t count = length - offset;
+        if (count > CONVERT_CHUNK_SIZE) {
+            count = CONVERT_CHUNK_SIZE;
+        }
+        xrec_read_bytes(&xrec, input + offset, (int)count);
+    }
+    srec_flush(&srec);
+
+    if (error != NULL) {
+        *error = (enum xrec_error)xrec.last_strict_error;
+    }
+    return srec.size;
+}
@@ -0,0 +1,85 @@
+/*
+ * xrec_srec.h
+ *
+ * Formatting of X-records as Motorola S-records, either to a caller-supplied
+ * sink or straight into a caller-supplied buffer.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * To convert a whole X-record capture held in memory, size the output with
+ * a first call and convert it with a second:
+ *
+ *      size_t size = xrec_to_srec(input, length, NULL, 0, NULL);
+ *      char *text = malloc(size);
+ *      xrec_to_srec(input, length, text, size, &error);
+ *
+ * The sizing call runs the parser but formats nothing. The text is not NUL
+ * terminated. Like `snprintf`, a call with a buffer that is too small
+ * writes only the lines that fit and still returns the full size.
+ *
+ * To format records as they arrive, set up a writer with a sink that
+ * receives each finished line, and pass it every record from the
+ * `xrec_data_read` callback:
+ *
+ *      srec_begin_write(&srec, my_sink, my_context);
+ *      ...
+ *      srec_write_record(&srec, record_type, address, data, length);
+ *
+ * Consecutive data records are packed into lines of up to 16 bytes, and a
+ * termination record ends the output with "S9030000FC". Neither function
+ * uses stdio or allocates memory.
+ */
+
+#ifndef XREC_SREC_H
+#define XREC_SREC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "xrec.h"
+
+#define SREC_MAX_DATA_BYTES_PER_LINE    16
+
+// "S1", count, address, data, checksum and newline.
+#define SREC_MAX_LINE_LENGTH    (2 + 2 + 4 + 2 * SREC_MAX_DATA_BYTES_PER_LINE + 2 + 1)
+
+struct srec_state;
+
+// Receives `length` bytes of finished output. If the sink is NULL, lines
+// are only counted, not formatted.
+typedef void (*srec_sink_t)(struct srec_state *srec, const char *text, size_t length);
+
+struct srec_state {
+    srec_sink_t     sink;
+    void *          context;            // For the sink's use
+    uint16_t        address;            // Starting address of this line
+    uint8_t         data[SREC_MAX_DATA_BYTES_PER_LINE];
+    int             length;             // Valid bytes in the data buffer
+    int             last_record_type;
+    size_t          size;               // Bytes of output so far
+};
+
+// Start a new output.
+void srec_begin_write(struct srec_state *srec, srec_sink_t sink, void *context);
+
+// Add one record to the output.
+void srec_write_record(struct srec_state *srec, int record_type, uint16_t address,
+                       const uint8_t *data, int length);
+
+// Write out the partial line being built, if any.
+void srec_flush(struct srec_state *srec);
+
+// Convert `length` bytes of X-records to S-record text in `out`, which has
+// room for `capacity` bytes, and return the size of the whole text. If `out`
+// is NULL nothing is written. Records that fail their checksum are
+// converted anyway; if `error` is not NULL, it is set to the last such
+// problem the parser found (XREC_ERROR_NONE if there were none). Data after
+// the last termination record is still converted.
+size_t xrec_to_srec(const char *input, size_t length, char *out, size_t capacity,
+                    enum xrec_error *error);
+
+#endif
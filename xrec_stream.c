@@ -0,0 +1,151 @@
+/*
+ * xrec_stream.c
+ *
+ * A bufferless X-record parser for hosts with very little memory.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <string.h>
+#include "xrec_stream.h"
+
+#define XREC_START 'X'
+
+enum xrec_stream_read_state {
+    STREAM_WAIT_FOR_START = 0,
+    STREAM_RECORD_TYPE,
+    STREAM_COUNT,
+    STREAM_ADDRESS_HIGH,
+    STREAM_ADDRESS_LOW,
+    STREAM_DATA,
+    STREAM_CHECKSUM
+};
+
+void
+xrec_stream_begin (struct xrec_stream *stream) {
+    stream->address = 0;
+    stream->remaining = 0;
+    stream->read_state = STREAM_WAIT_FOR_START;
+    stream->type = 0;
+    stream->count = 0;
+    stream->sum = 0;
+    stream->last_strict_error = XREC_ERROR_NONE;
+}
+
+// Pass on a run of payload bytes, adding them to the checksum.
+static void
+stream_payload (struct xrec_stream *stream, const uint8_t *data, int length) {
+    uint8_t sum = stream->sum;
+    for (int i = 0; i < length; i++) {
+        sum += data[i];
+    }
+    stream->sum = sum;
+    xrec_stream_data(stream, stream->address, data, length);
+    stream->address += length;
+    stream->remaining -= length;
+    if (stream->remaining == 0) {
+        stream->read_state = STREAM_CHECKSUM;
+    }
+}
+
+// Handle any byte other than a run of payload.
+static void
+stream_step (struct xrec_stream *stream, uint8_t b) {
+    switch (stream->read_state) {
+        case STREAM_WAIT_FOR_START:
+        {
+            if (b == XREC_START) {
+                stream->read_state = STREAM_RECORD_TYPE;
+            }
+            break;
+        }
+        case STREAM_RECORD_TYPE:
+        {
+            if (b == '1') {
+                stream->type = XREC_DATA_16BIT;
+                stream->read_state = STREAM_COUNT;
+            } else if (b == '9') {
+                stream->read_state = STREAM_WAIT_FOR_START;
+                xrec_stream_end(stream, XREC_TERMINATION_16BIT, 0, 0, 0);
+            } else {
+                // Revert to the wait state to try to re-sync.
+                stream->last_strict_error = XREC_ERROR_UNKNOWN_RECORD_TYPE;
+                stream->read_state = STREAM_WAIT_FOR_START;
+            }
+            break;
+        }
+        case STREAM_COUNT:
+        {
+            stream->count = b;
+            stream->remaining = (uint16_t)b + 1;
+            stream->sum = b;
+            stream->read_state = STREAM_ADDRESS_HIGH;
+            break;
+        }
+        case STREAM_ADDRESS_HIGH:
+        {
+            stream->address = (uint16_t)(b << 8);
+            stream->sum += b;
+            stream->read_state = STREAM_ADDRESS_LOW;
+            break;
+        }
+        case STREAM_ADDRESS_LOW:
+        {
+            stream->address |= b;
+            stream->sum += b;
+            stream->read_state = STREAM_DATA;
+            break;
+        }
+        case STREAM_DATA:
+        {
+            stream_payload(stream, &b, 1);
+            break;
+        }
+        case STREAM_CHECKSUM:
+        {
+            int length = stream->count + 1;
+            uint8_t expected = ~stream->sum;
+            int checksum_error = expected != b;
+            if (checksum_error) {
+                stream->last_strict_error = XREC_ERROR_INVALID_CHECKSUM;
+            }
+            stream->read_state = STREAM_WAIT_FOR_START;
+            xrec_stream_end(stream, stream->type, (uint16_t)(stream->address - length), length, checksum_error);
+            break;
+        }
+    }
+}
+
+void
+xrec_stream_read_byte (struct xrec_stream *stream, char byte) {
+    stream_step(stream, (uint8_t)byte);
+}
+
+void
+xrec_stream_read_bytes (struct xrec_stream * restrict stream,
+                        const char * restrict data,
+                        int count) {
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end = p + count;
+    while (p < end) {
+        if (stream->read_state == STREAM_WAIT_FOR_START) {
+            // Skip straight to the next start token.
+            p = memchr(p, XREC_START, end - p);
+            if (p == NULL) {
+                break;
+            }
+        } else if (stream->read_state == STREAM_DATA) {
+            // Hand on as much of the payload as this input holds in one go.
+            int length = stream->remaining;
+            if (length > end - p) {
+                length = (int)(end - p);
+            }
+            stream_payload(stream, p, length);
+            p += length;
+            continue;
+        }
+        stream_step(stream, *p++);
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * xrec_stream.h
+ *
+ * A bufferless X-record parser for hosts with very little memory. Payload
+ * bytes are handed on as they arrive instead of being collected into a
+ * record buffer, so the whole parser state is a dozen or so bytes.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ *      struct xrec_stream stream;
+ *      xrec_stream_begin(&stream);
+ *      xrec_stream_read_bytes(&stream, my_input_bytes, length_of_my_input_bytes);
+ *
+ * As with `xrec_read_bytes`, input may be supplied in pieces of any size.
+ * While a record's payload is being read, `xrec_stream_data` is called with
+ * each run of payload bytes found in the input passed to one call (a single
+ * byte at a time if fed through `xrec_stream_read_byte`), along with the
+ * address at which that run belongs. The checksum is accumulated as the
+ * bytes go by, and once it has been read `xrec_stream_end` is called with
+ * the verdict for the whole record. Termination records produce only the
+ * `xrec_stream_end` call.
+ *
+ * Because the payload is passed on before its checksum has been checked, a
+ * consumer that must not act on bad data (e.g. one writing into the memory
+ * of a running machine) should be prepared to reload or discard the range
+ * reported by `xrec_stream_end` when `checksum_error` is set.
+ *
+ * Both callbacks must be provided by the user of the library.
+ */
+
+#ifndef XREC_STREAM_H
+#define XREC_STREAM_H
+
+#include <stdint.h>
+#include "xrec.h"
+
+struct xrec_stream {
+    void *      context;
+    uint16_t    address;            // Address of the next payload byte
+    uint16_t    remaining;          // Payload bytes still to come
+    uint8_t     read_state;
+    uint8_t     type;
+    uint8_t     count;              // The record's count byte
+    uint8_t     sum;                // Running sum of count, address and payload
+    uint8_t     last_strict_error;  // As in `struct xrec_state`
+};
+
+// Begin reading
+void xrec_stream_begin(struct xrec_stream *stream);
+
+// Read a single character
+void xrec_stream_read_byte(struct xrec_stream *stream, char chr);
+
+// Read `count` characters from `data`
+void xrec_stream_read_bytes(struct xrec_stream * restrict stream,
+                            const char * restrict data,
+                            int count);
+
+// Callback for payload bytes. `data` points into the caller's input and
+// holds `length` bytes that belong at `address` onwards.
+extern void xrec_stream_data(struct xrec_stream *stream,
+                             uint16_t address,
+                             const uint8_t *data,
+                             int length);
+
+// Callback at the end of each record. For data records `address` and
+// `length` give the whole payload passed to `xrec_stream_data`, and
+// `checksum_error` is nonzero if the checksum doesn't match. Termination
+// records have a length of zero.
+extern void xrec_stream_end(struct xrec_stream *stream,
+                            int record_type,
+                            uint16_t address,
+                            int length,
+                            int checksum_error);
+
+#endif
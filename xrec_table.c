@@ -0,0 +1,173 @@
+/*
+ * xrec_table.c
+ *
+ * Parsed records as a table of columns.
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xrec_table.h"
+
+#define INITIAL_ROWS        1024
+#define INITIAL_PAYLOAD     (64 * 1024)
+#define TABLE_CHUNK_SIZE    0x40000000
+
+// What `xrec_table_parse` needs in its callback.
+struct parse_state {
+    struct xrec_table * table;
+    long                added;
+    int                 failed;
+};
+
+// Make room for one more row. Columns that grow before another fails keep
+// their new size, which is harmless.
+static int
+reserve_row (struct xrec_table *table) {
+    if (table->count < table->capacity) {
+        return 1;
+    }
+    long capacity = table->capacity * 2;
+    uint16_t *addresses = realloc(table->addresses, capacity * sizeof(*addresses));
+    if (addresses == NULL) {
+        return 0;
+    }
+    table->addresses = addresses;
+    uint16_t *lengths = realloc(table->lengths, capacity * sizeof(*lengths));
+    if (lengths == NULL) {
+        return 0;
+    }
+    table->lengths = lengths;
+    uint64_t *payload_offsets = realloc(table->payload_offsets, capacity * sizeof(*payload_offsets));
+    if (payload_offsets == NULL) {
+        return 0;
+    }
+    table->payload_offsets = payload_offsets;
+    uint8_t *status = realloc(table->status, capacity * sizeof(*status));
+    if (status == NULL) {
+        return 0;
+    }
+    table->status = status;
+    table->capacity = capacity;
+    return 1;
+}
+
+static int
+reserve_payload (struct xrec_table *table, int length) {
+    if (table->payload_length + length <= table->payload_capacity) {
+        return 1;
+    }
+    uint64_t capacity = table->payload_capacity * 2;
+    uint8_t *payload = realloc(table->payload, (size_t)capacity);
+    if (payload == NULL) {
+        return 0;
+    }
+    table->payload = payload;
+    table->payload_capacity = capacity;
+    return 1;
+}
+
+int
+xrec_table_init (struct xrec_table *table) {
+    memset(table, 0, sizeof(*table));
+    table->capacity = INITIAL_ROWS;
+    table->payload_capacity = INITIAL_PAYLOAD;
+    table->addresses = malloc(INITIAL_ROWS * sizeof(*table->addresses));
+    table->lengths = malloc(INITIAL_ROWS * sizeof(*table->lengths));
+    table->payload_offsets = malloc(INITIAL_ROWS * sizeof(*table->payload_offsets));
+    table->status = malloc(INITIAL_ROWS * sizeof(*table->status));
+    table->payload = malloc(INITIAL_PAYLOAD);
+    if (table->addresses == NULL || table->lengths == NULL || table->payload_offsets == NULL ||
+        table->status == NULL || table->payload == NULL) {
+        xrec_table_free(table);
+        return 0;
+    }
+    return 1;
+}
+
+void
+xrec_table_free (struct xrec_table *table) {
+    free(table->addresses);
+    free(table->lengths);
+    free(table->payload_offsets);
+    free(table->status);
+    free(table->payload);
+    memset(table, 0, sizeof(*table));
+}
+
+int
+xrec_table_add (struct xrec_table *table, int record_type, uint16_t address,
+                const uint8_t *data, int length, int checksum_error) {
+    if (!reserve_row(table) || !reserve_payload(table, length)) {
+        return 0;
+    }
+    long row = table->count++;
+    table->addresses[row] = address;
+    table->lengths[row] = (uint16_t)length;
+    table->payload_offsets[row] = table->payload_length;
+    table->status[row] = (checksum_error ? XREC_TABLE_CHECKSUM_ERROR : 0) |
+                         (record_type == XREC_TERMINATION_16BIT ? XREC_TABLE_TERMINATION : 0);
+    if (length > 0) {
+        memcpy(table->payload + table->payload_length, data, length);
+        table->payload_length += length;
+    }
+    return 1;
+}
+
+static enum xrec_action
+add_record (struct xrec_state *xrec,
+            int record_type,
+            uint16_t address,
+            uint8_t *data,
+            int length,
+            int checksum_error) {
+    struct parse_state *parse = xrec->context;
+    if (!xrec_table_add(parse->table, record_type, address, data, length, checksum_error)) {
+        parse->failed = 1;
+        return XREC_STOP;
+    }
+    parse->added++;
+    return XREC_CONTINUE;
+}
+
+long
+xrec_table_parse (struct xrec_table *table, const char *input, size_t length) {
+    struct parse_state parse = { table, 0, 0 };
+    struct xrec_state xrec;
+    xrec_begin_read(&xrec);
+#ifdef XREC_COMPACT_STATE
+    uint8_t record[XREC_RECORD_SIZE];
+    xrec.data = record;
+#endif
+    xrec.context = &parse;
+    xrec.callback = add_record;
+    for (size_t offset = 0; !parse.failed && offset < length; offset += TABLE_CHUNK_SIZE) {
+        size_t count = length - offset;
+        if (count > TABLE_CHUNK_SIZE) {
+            count = TABLE_CHUNK_SIZE;
+        }
+        xrec_read_bytes(&xrec, input + offset, (int)count);
+    }
+    return parse.failed ? -1 : parse.added;
+}
+
+void
+xrec_table_length_histogram (const struct xrec_table *table, uint64_t histogram[257]) {
+    const uint16_t *lengths = table->lengths;
+    for (long i = 0; i < table->count; i++) {
+        histogram[lengths[i]]++;
+    }
+}
+
+long
+xrec_table_count_status (const struct xrec_table *table, uint8_t mask) {
+    const uint8_t *status = table->status;
+    long count = 0;
+    for (long i = 0; i < table->count; i++) {
+        count += (status[i] & mask) != 0;
+    }
+    return count;
+}
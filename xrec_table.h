@@ -0,0 +1,78 @@
+/*
+ * xrec_table.h
+ *
+ * Parsed records as a table of columns, for analysis across many records
+ * at once (length histograms, address distributions, gaps and so on).
+ *
+ * Copyright (c) 2022 Ben Zotto
+ * Provided with absolutely no warranty, use at your own risk only.
+ * Use and distribute freely, mark modified copies as such.
+ *
+ *      USAGE
+ *      -----
+ *
+ * Parse a buffer straight into a table:
+ *
+ *      struct xrec_table table;
+ *      if (xrec_table_init(&table) && xrec_table_parse(&table, input, length) >= 0) {
+ *          for (long i = 0; i < table.count; i++) {
+ *              // table.addresses[i], table.lengths[i], table.status[i], and
+ *              // the payload at table.payload + table.payload_offsets[i]
+ *          }
+ *      }
+ *      xrec_table_free(&table);
+ *
+ * or add records to one from your own callback with `xrec_table_add`, e.g.
+ * to collect several inputs into one table.
+ *
+ * Each field is its own array, so a query over one field reads only that
+ * field's memory and compiles to a simple loop the compiler can vectorize.
+ * Payloads are packed end to end in one arena.
+ */
+
+#ifndef XREC_TABLE_H
+#define XREC_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "xrec.h"
+
+// Bits of `status`.
+#define XREC_TABLE_CHECKSUM_ERROR   0x01
+#define XREC_TABLE_TERMINATION      0x02    // An X9 record, with no payload
+
+struct xrec_table {
+    long        count;
+    long        capacity;           // Rows allocated in each column
+    uint16_t *  addresses;
+    uint16_t *  lengths;            // 0 to 256
+    uint64_t *  payload_offsets;    // Into `payload`
+    uint8_t *   status;
+    uint8_t *   payload;
+    uint64_t    payload_length;
+    uint64_t    payload_capacity;
+};
+
+// Set up an empty table. Returns nonzero on success.
+int xrec_table_init(struct xrec_table *table);
+
+// Release the table's memory.
+void xrec_table_free(struct xrec_table *table);
+
+// Append a record, with the arguments of the `xrec_data_read` callback.
+// Returns zero if there isn't enough memory, leaving the table unchanged.
+int xrec_table_add(struct xrec_table *table, int record_type, uint16_t address,
+                   const uint8_t *data, int length, int checksum_error);
+
+// Parse `length` bytes of X-records and append every record found. Returns
+// the number of records added, or -1 if memory ran out (the records before
+// that are kept).
+long xrec_table_parse(struct xrec_table *table, const char *input, size_t length);
+
+// Count the records of each payload length, adding to `histogram[0..256]`.
+void xrec_table_length_histogram(const struct xrec_table *table, uint64_t histogram[257]);
+
+// Number of records whose status has any of the bits in `mask` set.
+long xrec_table_count_status(const struct xrec_table *table, uint8_t mask);
+
+#endif